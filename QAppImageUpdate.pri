@@ -6,8 +6,16 @@ HEADERS += \
     $$PWD/include/zsyncremotecontrolfileparser_p.hpp \
     $$PWD/include/zsyncinternalstructures_p.hpp \
     $$PWD/include/zsyncwriter_p.hpp \
+    $$PWD/include/zsyncrollingchecksum_p.hpp \
+    $$PWD/include/zsyncmd4_p.hpp \
+    $$PWD/include/zsyncblockranges_p.hpp \
+    $$PWD/include/zsyncblockwriter_p.hpp \
+    $$PWD/include/zsyncprefixhasher_p.hpp \
+    $$PWD/include/zsyncjournal_p.hpp \
     $$PWD/include/rangereply_p.hpp \
     $$PWD/include/rangereply.hpp \
+    $$PWD/include/byterangesparser_p.hpp \
+    $$PWD/include/bufferpool_p.hpp \
     $$PWD/include/rangedownloader_p.hpp \
     $$PWD/include/rangedownloader.hpp \
     $$PWD/include/qappimageupdateenums.hpp \
@@ -21,8 +29,16 @@ SOURCES += \
     $$PWD/src/appimageupdateinformation_p.cc \
     $$PWD/src/zsyncremotecontrolfileparser_p.cc \
     $$PWD/src/zsyncwriter_p.cc \
+    $$PWD/src/zsyncrollingchecksum_p.cc \
+    $$PWD/src/zsyncmd4_p.cc \
+    $$PWD/src/zsyncblockranges_p.cc \
+    $$PWD/src/zsyncblockwriter_p.cc \
+    $$PWD/src/zsyncprefixhasher_p.cc \
+    $$PWD/src/zsyncjournal_p.cc \
     $$PWD/src/rangereply_p.cc \
     $$PWD/src/rangereply.cc \
+    $$PWD/src/byterangesparser_p.cc \
+    $$PWD/src/bufferpool_p.cc \
     $$PWD/src/rangedownloader_p.cc \
     $$PWD/src/rangedownloader.cc \
     $$PWD/src/qappimageupdate_p.cc \
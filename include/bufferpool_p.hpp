@@ -0,0 +1,31 @@
+#ifndef BUFFER_POOL_PRIVATE_HPP_INCLUDED
+#define BUFFER_POOL_PRIVATE_HPP_INCLUDED
+#include <QByteArray>
+#include <QMutex>
+#include <QVector>
+
+/*
+ * A pool of preallocated byte arrays shared between the range replies
+ * and the writer in full download mode, So the data goes from the
+ * socket buffer to the target file without a heap allocation per
+ * fragment.
+ *
+ * acquire() and release() are thread safe. A released buffer may still
+ * be shared with the block writer, It is only handed out again once the
+ * writer has let go of it.
+*/
+class BufferPool {
+  public:
+    BufferPool(int bufferSize = 65536, int maxBuffers = 128);
+    ~BufferPool();
+
+    int bufferSize() const;
+    QByteArray *acquire();
+    void release(QByteArray*);
+  private:
+    int n_BufferSize,
+        n_MaxBuffers;
+    QMutex m_Mutex;
+    QVector<QByteArray*> m_Free;
+};
+#endif // BUFFER_POOL_PRIVATE_HPP_INCLUDED
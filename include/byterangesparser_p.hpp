@@ -0,0 +1,49 @@
+#ifndef BYTE_RANGES_PARSER_PRIVATE_HPP_INCLUDED
+#define BYTE_RANGES_PARSER_PRIVATE_HPP_INCLUDED
+#include <QtGlobal>
+#include <QByteArray>
+#include <QVector>
+
+/*
+ * Streaming parser for a multipart/byteranges response body, The answer
+ * of a server to a GET with more than one range.
+ *
+ * Feed the body as it arrives, Every part is available from takePart()
+ * as soon as its last byte is in. The length of a part is taken from its
+ * Content-Range header, So the data of a part is never searched for the
+ * boundary.
+*/
+class ByteRangesParser {
+  public:
+    struct Part {
+        qint64 from,  /* first byte of the part in the file. */
+               to,    /* last byte of the part in the file. */
+               total; /* length of the file, -1 if the server did not say. */
+        QByteArray data;
+    };
+
+    explicit ByteRangesParser(const QByteArray&);
+
+    bool feed(const QByteArray&);
+    bool takePart(Part*);
+    bool isFinished() const;
+
+    static QByteArray boundaryOf(const QByteArray&);
+    static bool parseContentRange(const QByteArray&, qint64*, qint64*, qint64 *total = nullptr);
+  private:
+    enum State {
+        Delimiter,
+        Headers,
+        Body,
+        Done
+    };
+
+    bool parse();
+
+    State m_State = Delimiter;
+    QByteArray m_Delimiter,
+               m_Pending; /* bytes we could not parse yet. */
+    Part m_Part;
+    QVector<Part> m_Parts; /* parts done but not taken. */
+};
+#endif // BYTE_RANGES_PARSER_PRIVATE_HPP_INCLUDED
@@ -3,6 +3,7 @@
 #include <QObject>
 #include <QSharedPointer>
 #include <QString>
+#include <QStringList>
 #include <QFile>
 #include <QNetworkProxy>
 #include <QByteArray>
@@ -40,6 +41,8 @@ class QAppImageUpdate : public QObject {
     void setAppImage(QFile*);
     void setShowLog(bool);
     void setOutputDirectory(const QString&);
+    void setSeedFiles(const QStringList&);
+    void setConcurrentRequests(int, int);
     void setProxy(const QNetworkProxy&);
     void start(short action = Action::Update,
                int flags = GuiFlag::None,
@@ -50,6 +53,7 @@ class QAppImageUpdate : public QObject {
   Q_SIGNALS:
     void torrentClientStarted();
     void torrentStatus(int,int);
+    void concurrentRequests(int);
     void started(short);
     void canceled(short);
     void finished(QJsonObject info, short);
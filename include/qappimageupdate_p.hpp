@@ -5,6 +5,7 @@
 #include <QScopedPointer>
 #include <QSharedPointer>
 #include <QString>
+#include <QStringList>
 #include <QFile>
 #include <QByteArray>
 #include <QNetworkProxy>
@@ -49,6 +50,8 @@ class QAppImageUpdatePrivate : public QObject {
     void setAppImage(QFile*);
     void setShowLog(bool);
     void setOutputDirectory(const QString&);
+    void setSeedFiles(const QStringList&);
+    void setConcurrentRequests(int, int);
     void setProxy(const QNetworkProxy&);
     void start(short action = Action::Update,
                int flags = GuiFlag::None,
@@ -92,6 +95,7 @@ class QAppImageUpdatePrivate : public QObject {
   Q_SIGNALS:
     void torrentClientStarted();
     void torrentStatus(int,int);
+    void concurrentRequests(int);
     void started(short);
     void canceled(short);
     void finished(QJsonObject info, short);
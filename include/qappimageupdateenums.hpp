@@ -119,6 +119,7 @@ struct QAppImageUpdateEnums {
             NoPermissionToReadWriteTargetFile,
             CannotOpenTargetFile,
             TargetFileSha1HashMismatch,
+            CannotWriteTargetFile,
 
 	    /* Seeder errors. */
 	    TorrentNotSupported = 200,
@@ -3,6 +3,7 @@
 #ifdef BUILD_AS_PLUGIN
 #include <QtPlugin>
 #include <QString>
+#include <QStringList>
 #include <QFile>
 #include <QNetworkProxy>
 #include <QJsonObject>
@@ -16,6 +17,8 @@ class QAppImageUpdateInterface {
     virtual void setAppImageFile(QFile*) = 0;
     virtual void setShowLog(bool) = 0;
     virtual void setOutputDirectory(const QString&) = 0;
+    virtual void setSeedFiles(const QStringList&) = 0;
+    virtual void setConcurrentRequests(int, int) = 0;
     virtual void setProxy(const QNetworkProxy&) = 0;
     virtual void start(short) = 0;
     virtual void cancel() = 0;
@@ -29,6 +32,7 @@ class QAppImageUpdateInterface {
   Q_SIGNALS:
     virtual void torrentClientStarted() = 0;
     virtual void torrentStatus(int,int) = 0;
+    virtual void concurrentRequests(int) = 0;
     virtual void started(short) = 0;
     virtual void canceled(short) = 0;
     virtual void finished(QJsonObject info, short) = 0;
@@ -38,8 +42,10 @@ class QAppImageUpdateInterface {
     virtual void quit() = 0;
 };
 
+/* Bump the version whenever the interface changes, So an old plugin is
+ * not loaded into an application built for a newer interface. */
 #ifndef QAppImageUpdateInterface_iid
-#define QAppImageUpdateInterface_iid "com.antony-jr.QAppImageUpdate"
+#define QAppImageUpdateInterface_iid "com.antony-jr.QAppImageUpdate/2.1"
 #endif
 
 Q_DECLARE_INTERFACE(QAppImageUpdateInterface, QAppImageUpdateInterface_iid);
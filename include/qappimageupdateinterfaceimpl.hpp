@@ -28,6 +28,8 @@ class QAppImageUpdateInterfaceImpl : public QObject, QAppImageUpdateInterface {
     void setAppImageFile(QFile*);
     void setShowLog(bool);
     void setOutputDirectory(const QString&);
+    void setSeedFiles(const QStringList&);
+    void setConcurrentRequests(int, int);
     void setProxy(const QNetworkProxy&);
     void start(short action);
     void cancel();
@@ -41,6 +43,7 @@ class QAppImageUpdateInterfaceImpl : public QObject, QAppImageUpdateInterface {
   Q_SIGNALS:
     void torrentClientStarted();
     void torrentStatus(int,int);
+    void concurrentRequests(int);
     void started(short);
     void canceled(short);
     void finished(QJsonObject info, short);
@@ -6,19 +6,25 @@
 #include <QNetworkReply>
 
 class RangeDownloaderPrivate;
+class BufferPool;
 
 class RangeDownloader : public QObject {
     Q_OBJECT
     QSharedPointer<RangeDownloaderPrivate> m_Private;
+    QSharedPointer<BufferPool> m_BufferPool;
   public:
     RangeDownloader(QNetworkAccessManager*, QObject *parent = nullptr);
+
+    void recycle(QByteArray*);
   public Q_SLOTS:
     void setBlockSize(qint32);
     void setTargetFileUrl(const QUrl&);
-    void setTargetFileLength(qint32);
+    void setTargetFileLength(qint64);
     void setBytesWritten(qint64);
+    void setConcurrentRequests(int, int);
     void setFullDownload(bool);
     void appendRange(qint32, qint32);
+    void requeueRange(qint32, qint32);
 
     void start();
     void cancel();
@@ -29,7 +35,9 @@ class RangeDownloader : public QObject {
     void error(QNetworkReply::NetworkError);
 
     void data(QByteArray *, bool);
-    void rangeData(qint32, qint32, QByteArray *,bool);
+    void rangeData(qint32, qint32, QByteArray *);
+    void rangesCoalesced(qint32, qint64, qint64);
+    void concurrentRequests(int);
     void progress(int, qint64, qint64, double, QString);
 };
 #endif // RANGE_DOWNLOADER_HPP_INCLUDED
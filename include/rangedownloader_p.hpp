@@ -6,27 +6,34 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QElapsedTimer>
+#include <QSharedPointer>
+#include <QHash>
 
 #include "rangereply.hpp"
+#include "bufferpool_p.hpp"
 
 class RangeDownloaderPrivate : public QObject {
     Q_OBJECT
   public:
-    RangeDownloaderPrivate(QNetworkAccessManager*, QObject *parent = nullptr);
+    RangeDownloaderPrivate(QNetworkAccessManager*, const QSharedPointer<BufferPool>&,
+                           QObject *parent = nullptr);
     ~RangeDownloaderPrivate();
   public Q_SLOTS:
     void setBlockSize(qint32);
     void setTargetFileUrl(const QUrl&);
     void setBytesWritten(qint64);
-    void setTargetFileLength(qint32);
+    void setTargetFileLength(qint64);
+    void setConcurrentRequests(int, int);
     void setFullDownload(bool);
     void appendRange(qint32, qint32);
+    void requeueRange(qint32, qint32);
 
     void start();
     void cancel();
 
   private Q_SLOTS:
     QNetworkRequest makeRangeRequest(const QUrl&, const QPair<qint32,qint32>&);
+    QNetworkRequest makeMultiRangeRequest(const QUrl&, const QVector<QPair<qint32,qint32>>&);
     void handleUrlCheckError(QNetworkReply::NetworkError);
     void handleUrlCheck(qint64, qint64);
     void handleRangeReplyCancel(int);
@@ -34,6 +41,7 @@ class RangeDownloaderPrivate : public QObject {
     void handleRangeReplyProgress(qint64, int);
     void handleRangeReplyError(QNetworkReply::NetworkError, int, bool);
     void handleRangeReplyFinished(qint32,qint32,QByteArray*, int);
+    void handleRangeReplyPart(qint32,qint32,QByteArray*, int);
   Q_SIGNALS:
     void started();
     void canceled();
@@ -41,26 +49,57 @@ class RangeDownloaderPrivate : public QObject {
     void error(QNetworkReply::NetworkError);
 
     void data(QByteArray *, bool);
-    void rangeData(qint32, qint32, QByteArray *, /*this is true when the given range is the last one*/bool);
+    void rangeData(qint32, qint32, QByteArray *);
+    void rangesCoalesced(qint32, qint64, qint64);
+    void concurrentRequests(int);
 
     void progress(int, qint64, qint64, double, QString);
   private:
+    RangeReply *startRangeReply(int, const QVector<QPair<qint32, qint32>>&);
+    void startNextRangeReply(int);
+    QVector<QPair<qint32, qint32>> takeRanges();
+    qint64 gapThreshold() const;
+    void fillWindow();
+    void adaptWindow(qint64);
+    void shrinkWindow();
+    void requeuePendingParts(int);
+
     bool b_Finished = false,
          b_Running = false,
          b_CancelRequested = false,
-         b_FullDownload = false;
+         b_FullDownload = false,
+         b_MultiRange = true; /* ask for many ranges per request until the server fails us. */
     int n_Active = -1,
         n_Done = 0;
     QUrl m_Url;
     qint32 n_BlockSize = 1024;
     qint64 n_BytesWritten = 0;
     qint64 n_TotalSize = -1;
-    qint64 n_RecievedBytes;
+    qint64 n_RecievedBytes = 0;
+    qint64 n_Rtt = 0, /* ms to the first byte of the url check. */
+           n_ProbeSpeed = 0, /* bytes per second of the url check. */
+           n_ProbeFrom = -1,
+           n_ProbeStart = -1;
+    qint32 n_RequestedRanges = 0; /* ranges asked for after merging. */
+    qint64 n_RedundantBytes = 0; /* bytes between merged ranges. */
+    int n_MinWindow,
+        n_MaxWindow,
+        n_Window = 1, /* no. of range requests allowed in flight. */
+        n_WindowAcks = 0; /* replies finished since the window last changed. */
+    qint64 n_MinLatency = 0, /* ms of the fastest reply so far. */
+           n_EpochLatency = 0, /* ms of the slowest reply since the window last changed. */
+           n_EpochStart = 0,
+           n_EpochBytes = 0,
+           n_LastGoodput = 0, /* bytes per second over the last window of replies. */
+           n_LastDecrease = -1;
+    QHash<int, qint64> m_ReplyStart; /* when the reply at an index was started. */
 
     QNetworkAccessManager *m_Manager;
+    QSharedPointer<BufferPool> m_BufferPool; /* shared with the receiver of the data signal. */
     QElapsedTimer m_ElapsedTimer;
     QVector<QPair<qint32, qint32>> m_RequiredBlocks;
     QVector<RangeReply*> m_ActiveRequests;
+    QHash<int, QVector<QPair<qint32, qint32>>> m_PendingParts; /* ranges not yet got by the multi range reply at an index. */
 
 };
 #endif // RANGE_DOWNLOADER_PRIVATE_HPP_INCLUDED
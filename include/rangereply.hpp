@@ -3,14 +3,19 @@
 #include <QObject>
 #include <QSharedPointer>
 #include <QNetworkReply>
+#include <QVector>
 
 class RangeReplyPrivate; // Forward Declare.
+class BufferPool;
 
 class RangeReply : public QObject {
     Q_OBJECT
     QSharedPointer<RangeReplyPrivate> m_Private;
+    void connectPrivate();
   public:
-    RangeReply(int, QNetworkReply*, const QPair<qint32, qint32>&);
+    RangeReply(int, QNetworkReply*, const QPair<qint32, qint32>&,
+               const QSharedPointer<BufferPool>& = QSharedPointer<BufferPool>());
+    RangeReply(int, QNetworkReply*, const QVector<QPair<qint32, qint32>>&, qint32);
     ~RangeReply();
   public Q_SLOTS:
     void destroy();
@@ -22,6 +27,7 @@ class RangeReply : public QObject {
     void progress(qint64, int);
     void data(QByteArray*, bool);
     void finished(qint32,qint32,  QByteArray*, int);
+    void part(qint32, qint32, QByteArray*, int);
     void canceled(int);
 };
 #endif // RANGE_REPLY_HPP_INCLUDED
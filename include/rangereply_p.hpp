@@ -9,12 +9,18 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QScopedPointer>
+#include <QSharedPointer>
+
+#include "bufferpool_p.hpp"
+#include "byterangesparser_p.hpp"
 
 
 class RangeReplyPrivate : public QObject {
     Q_OBJECT
   public:
-    RangeReplyPrivate(int, QNetworkReply*, const QPair<qint32, qint32>&);
+    RangeReplyPrivate(int, QNetworkReply*, const QPair<qint32, qint32>&,
+                      const QSharedPointer<BufferPool>&);
+    RangeReplyPrivate(int, QNetworkReply*, const QVector<QPair<qint32, qint32>>&, qint32);
     ~RangeReplyPrivate();
 
   public Q_SLOTS:
@@ -34,24 +40,39 @@ class RangeReplyPrivate : public QObject {
     void progress(qint64, int);
     void data(QByteArray*, bool);
     void finished(qint32,qint32,QByteArray*, int);
+    void part(qint32, qint32, QByteArray*, int);
     void canceled(int);
   private:
+    QByteArray *readFragment();
+    bool startParts();
+    bool handleParts(const QByteArray&);
+    void servePart(qint64, const QByteArray&, qint64);
+    void fallback();
+
     bool b_Running = true, /* When constructed, the reply will be running. */
          b_Finished = false,
          b_Canceled = false,
          b_CancelRequested = false,
          b_Retrying = false,
          b_Halted = false,
-         b_FullDownload = false;
+         b_FullDownload = false,
+         b_MultiRange = false,
+         b_SinglePart = false;
     int n_Index;
     int n_Fails;
-    qint64 n_BytesRecieved;
+    qint64 n_BytesRecieved,
+           n_SinglePartOffset = 0, /* offset of m_Data in the file when the server merged our ranges. */
+           n_SinglePartTotal = -1; /* length of the file then, -1 if unknown. */
     qint32 n_FromBlock,
-           n_ToBlock;
+           n_ToBlock,
+           n_BlockSize = 0;
+    QVector<QPair<qint32, qint32>> m_Ranges; /* ranges of a multi range request not served yet. */
     QTimer m_Timer;
     QScopedPointer<QNetworkReply> m_Reply;
     QNetworkRequest m_Request;
     QNetworkAccessManager *m_Manager;
     QScopedPointer<QByteArray> m_Data;
+    QSharedPointer<BufferPool> m_BufferPool; /* fragment buffers in full download mode. */
+    QScopedPointer<ByteRangesParser> m_Parser;
 };
 #endif // RANGE_REPLY_PRIVATE_INCLUDED
@@ -0,0 +1,92 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncblockranges_p.hpp
+ * @description : Set of the target file blocks we already have.
+*/
+#ifndef ZSYNC_BLOCK_RANGES_PRIVATE_HPP_INCLUDED
+#define ZSYNC_BLOCK_RANGES_PRIVATE_HPP_INCLUDED
+#include <QtGlobal>
+#include <QMap>
+
+#include "zsyncinternalstructures_p.hpp"
+
+/*
+ * Stores the known blocks as disjoint, non adjacent inclusive intervals
+ * keyed by their first block, So insert, merge and lookup are all
+ * logarithmic in the no. of intervals.
+*/
+class ZsyncBlockRanges {
+  public:
+    void clear();
+    void add(zs_blockid);
+    void add(zs_blockid, zs_blockid);
+    bool contains(zs_blockid) const;
+    zs_blockid nextKnown(zs_blockid, zs_blockid) const;
+    qint32 count() const;
+    bool isEmpty() const;
+
+    /*
+     * Calls f(from, to) for every half open range [from, to) of unknown
+     * blocks within [begin, end), in order.
+    */
+    template <typename F>
+    void forEachGap(zs_blockid begin, zs_blockid end, F f) const {
+        zs_blockid cur = begin;
+        auto iter = m_Ranges.upperBound(begin);
+        if (iter != m_Ranges.constBegin()) {
+            auto prev = iter;
+            --prev;
+            cur = qMax(cur, prev.value() + 1);
+        }
+        for (; iter != m_Ranges.constEnd() && iter.key() < end; ++iter) {
+            if (iter.key() > cur) {
+                f(cur, iter.key());
+            }
+            cur = qMax(cur, iter.value() + 1);
+        }
+        if (cur < end) {
+            f(cur, end);
+        }
+    }
+
+    /* Calls f(first, last) for every known inclusive range, in order. */
+    template <typename F>
+    void forEachRange(F f) const {
+        for (auto iter = m_Ranges.constBegin(); iter != m_Ranges.constEnd(); ++iter) {
+            f(iter.key(), iter.value());
+        }
+    }
+  private:
+    QMap<zs_blockid, zs_blockid> m_Ranges; /* first block -> last block. */
+};
+
+#endif // ZSYNC_BLOCK_RANGES_PRIVATE_HPP_INCLUDED
@@ -0,0 +1,91 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncblockwriter_p.hpp
+ * @description : Writes the blocks of the target file on its own thread.
+*/
+#ifndef ZSYNC_BLOCK_WRITER_PRIVATE_HPP_INCLUDED
+#define ZSYNC_BLOCK_WRITER_PRIVATE_HPP_INCLUDED
+#include <QtGlobal>
+#include <QByteArray>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "zsyncprefixhasher_p.hpp"
+
+/*
+ * Takes (offset, data) writes for the under construction target file from
+ * the seed scan and the range verifier and writes them on its own thread,
+ * So the scan does not wait on the disk.
+ *
+ * Queued writes are sorted by offset and the adjacent ones are written
+ * with a single pwritev. Written data is also fed to a prefix hasher,
+ * So the SHA-1 of the target is mostly done when the last block lands.
+*/
+class ZsyncBlockWriter : public QThread {
+  public:
+    explicit ZsyncBlockWriter(int, qint64);
+    ~ZsyncBlockWriter();
+
+    bool preallocate(qint64);
+    void write(qint64, const unsigned char*, qint64);
+    void write(qint64, const QByteArray&, qint64, qint64);
+    bool flush();
+    ZsyncPrefixHasher *hasher();
+  protected:
+    void run() override;
+  private:
+    struct Item {
+        qint64 offset;    /* offset in the target file. */
+        QByteArray data;  /* shared buffer holding the data. */
+        qint64 from;      /* start of the data in the buffer. */
+        qint64 length;    /* no. of bytes to write. */
+    };
+
+    bool waitForRoom(qint64);
+    void enqueue(Item);
+    bool writeItems(QVector<Item>*);
+
+    int n_Fd = -1;
+    bool b_Stop = false,
+         b_Busy = false;
+    int n_Error = 0;         /* errno of the first failed write, 0 if none. */
+    qint64 n_QueuedBytes = 0;
+    QVector<Item> m_Queue;
+    ZsyncPrefixHasher m_Hasher; /* only touched by the writer thread or after flush. */
+    QMutex m_Mutex;
+    QWaitCondition m_Queued,
+                   m_Drained;
+};
+
+#endif // ZSYNC_BLOCK_WRITER_PRIVATE_HPP_INCLUDED
@@ -37,7 +37,31 @@
 #include <QtGlobal>
 
 static constexpr unsigned short CHECKSUM_SIZE = 16;
-static constexpr unsigned short BITHASHBITS = 3;
+/* Bits of the seed filter per target block and no. of bits probed per
+ * lookup, More bits per block lower the false positive rate of the filter. */
+static constexpr qint32 SEED_FILTER_BITS_PER_BLOCK = 16;
+static constexpr qint32 SEED_FILTER_PROBES = 3;
+/* No. of seed bytes scanned between progress reports, This is also the
+ * no. of seed bytes handed to a single worker in a parallel seed scan. */
+static constexpr qint64 SEED_SCAN_CHUNK_SIZE = 4194304;
+/* Upper bound on the no. of workers used for a parallel seed scan. */
+static constexpr int PARALLEL_SCAN_MAX_THREADS = 16;
+/* No. of block aligned windows and of rolled stretches sampled from each
+ * seed to rank the seeds before they are scanned. */
+static constexpr qint64 SEED_SAMPLE_ALIGNED = 256;
+static constexpr qint64 SEED_SAMPLE_ROLLING = 128;
+/* No. of blocks checked per batch in the aligned pass over a seed. */
+static constexpr qint32 ALIGNED_SCAN_BATCH = 64;
+/* Min. no. of bytes of a downloaded range hashed by one verify worker,
+ * Smaller ranges are verified on the writer thread. */
+static constexpr qint64 VERIFY_SLICE_MIN_SIZE = 1048576;
+/* Min. milliseconds between two saves of the resume journal while
+ * downloading. */
+static constexpr qint64 JOURNAL_SAVE_INTERVAL = 5000;
+/* Max. no. of times the rest of a downloaded range is requested again
+ * when its blocks fail the MD4 check, Counted for each block it failed at,
+ * So one bad range cannot use up the retries of the others. */
+static constexpr qint32 RANGE_REQUEUE_LIMIT = 16;
 typedef qint32 zs_blockid;
 
 struct rsum {
@@ -45,9 +69,25 @@ struct rsum {
     unsigned short	b;
 } __attribute__((packed));
 
-struct hash_entry {
-    struct hash_entry *next;    /* next entry with the same rsum */
-    struct rsum r;
-    unsigned char checksum[CHECKSUM_SIZE];
+/*
+ * A slot of the open addressing rsum hash table, Blocks with the same
+ * rsum are found by probing linearly from the home slot of the key until
+ * an empty slot. The key itself is not stored, It is the rsum of the block
+ * which is looked up when a slot is checked.
+*/
+struct zs_hash_slot {
+    zs_blockid id;    /* block id, or one of the HASH_SLOT_* markers. */
+};
+static constexpr zs_blockid HASH_SLOT_EMPTY = -1;
+static constexpr zs_blockid HASH_SLOT_REMOVED = -2;
+/* Min. no. of removed slots before the rsum hash table is rebuilt without
+ * them, See ZsyncWriterPrivate::compactHash. */
+static constexpr qint32 HASH_COMPACT_MIN = 4096;
+
+/* A run of target blocks found in a seed by a parallel scan worker. */
+struct zs_match {
+    qint64 offset;    /* offset of the run in the scanned buffer. */
+    zs_blockid id;    /* first target block of the run. */
+    qint32 blocks;    /* no. of consecutive target blocks in the run. */
 };
 #endif // ZSYNC_INTERNAL_STRUCTURES_HPP_INCLUDED
@@ -0,0 +1,68 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncjournal_p.hpp
+ * @description : Sidecar journal of the verified blocks of a partial target file.
+*/
+#ifndef ZSYNC_JOURNAL_PRIVATE_HPP_INCLUDED
+#define ZSYNC_JOURNAL_PRIVATE_HPP_INCLUDED
+#include <QtGlobal>
+#include <QString>
+
+#include "zsyncblockranges_p.hpp"
+
+/*
+ * Records which blocks of an under construction target file are written
+ * and verified, Next to the .part file as <.part file>.journal.
+ *
+ * The journal also holds the identity of the target (SHA-1, length and
+ * block size), So an interrupted update can adopt the known blocks of its
+ * .part file without scanning it when the same target is updated again.
+ *
+ * The journal is replaced atomically, It only ever claims blocks which
+ * were synced to the .part file before it was saved.
+*/
+class ZsyncJournal {
+  public:
+    ZsyncJournal(const QString&, qint64, qint32, qint32);
+
+    static QString pathOf(const QString&);
+
+    bool save(const QString&, const ZsyncBlockRanges&) const;
+    bool load(const QString&, ZsyncBlockRanges*) const;
+  private:
+    QString s_TargetFileSHA1;
+    qint64 n_TargetFileLength = 0;
+    qint32 n_BlockSize = 0,
+           n_Blocks = 0;
+};
+
+#endif // ZSYNC_JOURNAL_PRIVATE_HPP_INCLUDED
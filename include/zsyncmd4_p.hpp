@@ -0,0 +1,59 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncmd4_p.hpp
+ * @description : Native MD4 for the zsync strong checksums.
+*/
+#ifndef ZSYNC_MD4_PRIVATE_HPP_INCLUDED
+#define ZSYNC_MD4_PRIVATE_HPP_INCLUDED
+#include <cstddef>
+#include <QtGlobal>
+
+#include "zsyncinternalstructures_p.hpp"
+
+/*
+ * Computes the MD4 digest of data[0 .. len - 1] into digest.
+ * Does not allocate, Safe to call from any thread.
+*/
+void md4_digest(const unsigned char *data, size_t len, unsigned char *digest);
+
+/*
+ * Computes the MD4 digests of n messages of the same length, such that
+ * digests + CHECKSUM_SIZE * i is the digest of data[i].
+ * Messages are hashed 8 or 4 at a time in SIMD lanes when the cpu
+ * supports it, The kernel is selected on the first call.
+*/
+void md4_digest_many(const unsigned char *const *data, size_t len, qint32 n, unsigned char *digests);
+
+/* Name of the multi buffer kernel used by md4_digest_many, for logging. */
+const char *md4_digest_many_kernel_name();
+
+#endif // ZSYNC_MD4_PRIVATE_HPP_INCLUDED
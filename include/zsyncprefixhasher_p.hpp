@@ -0,0 +1,76 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncprefixhasher_p.hpp
+ * @description : SHA-1 of the target file computed as its contiguous prefix is written.
+*/
+#ifndef ZSYNC_PREFIX_HASHER_PRIVATE_HPP_INCLUDED
+#define ZSYNC_PREFIX_HASHER_PRIVATE_HPP_INCLUDED
+#include <QtGlobal>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QMap>
+
+/*
+ * Feeds the SHA-1 hash of the target file with the written data as the
+ * contiguous prefix from offset 0 grows, So verification at the end
+ * only has to read the part of the file which was never covered.
+ *
+ * Data written ahead of the prefix is held in a small reorder buffer
+ * until the gap before it is filled. When the buffer is full, the data
+ * farthest from the prefix is dropped and read back from the file later.
+*/
+class ZsyncPrefixHasher {
+  public:
+    explicit ZsyncPrefixHasher(qint64);
+
+    void update(qint64, const QByteArray&, qint64, qint64);
+    void addData(const QByteArray&);
+    qint64 prefix() const;
+    QByteArray result();
+  private:
+    struct Pending {
+        QByteArray data;  /* shared buffer holding the data. */
+        qint64 from;      /* start of the data in the buffer. */
+        qint64 length;    /* no. of bytes. */
+    };
+
+    void consume(qint64, const char*, qint64);
+    void drain();
+
+    QCryptographicHash m_Hash;
+    qint64 n_Length = 0,
+           n_Prefix = 0,
+           n_PendingBytes = 0;
+    QMap<qint64, Pending> m_Pending; /* offset -> data written ahead of the prefix. */
+};
+
+#endif // ZSYNC_PREFIX_HASHER_PRIVATE_HPP_INCLUDED
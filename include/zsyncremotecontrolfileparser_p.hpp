@@ -87,7 +87,7 @@ class ZsyncRemoteControlFileParserPrivate : public QObject {
 #endif // LOGGING_DISABLED
   Q_SIGNALS:
     void zsyncInformation(qint32,qint32,qint32,
-                          qint32,qint32,qint32,
+                          qint32,qint32,qint64,
                           QString,QString,QString,
                           QUrl,QBuffer*,bool,QUrl);
     void updateCheckInformation(QJsonObject);
@@ -114,8 +114,8 @@ class ZsyncRemoteControlFileParserPrivate : public QObject {
 #endif // LOGGING_DISABLED
     QDateTime m_MTime;
     qint32 n_TargetFileBlockSize = 0,
-           n_TargetFileLength = 0,
            n_TargetFileBlocks = 0;
+    qint64 n_TargetFileLength = 0;
     qint32 n_WeakCheckSumBytes = 0,
            n_StrongCheckSumBytes = 0,
            n_ConsecutiveMatchNeeded = 0;
@@ -0,0 +1,68 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncrollingchecksum_p.hpp
+ * @description : Vectorized kernels for the zsync rolling checksum.
+*/
+#ifndef ZSYNC_ROLLING_CHECKSUM_PRIVATE_HPP_INCLUDED
+#define ZSYNC_ROLLING_CHECKSUM_PRIVATE_HPP_INCLUDED
+#include <QtGlobal>
+
+#include "zsyncinternalstructures_p.hpp"
+
+/* No. of window positions rolled at once by rsum_roll callers. */
+static constexpr qint32 RSUM_ROLL_BATCH = 64;
+
+/*
+ * Rolls the rsum r of the window at data over the next n windows,
+ * such that (a[k], b[k]) is the rsum of the window at data + k + 1.
+ * data[0 .. n + blocksize - 1] must be readable.
+ *
+ * The best kernel for the running cpu is selected on the first call.
+*/
+void rsum_roll(const unsigned char *data, qint32 blocksize, qint32 blockshift,
+               rsum r, qint32 n, unsigned short *a, unsigned short *b);
+
+/* Name of the kernel used by rsum_roll, for logging. */
+const char *rsum_roll_kernel_name();
+
+typedef void (*rsum_roll_kernel)(const unsigned char*, qint32, qint32,
+                                 rsum, qint32, unsigned short*, unsigned short*);
+
+/*
+ * Returns the rsum_roll kernel for the running cpu, specialized for the
+ * given block shift when it is a common one (1024, 2048 or 4096 byte
+ * blocks). Callers which roll a lot with the same block size select it once,
+ * The blocksize and blockshift passed to it must still be the right ones.
+*/
+rsum_roll_kernel rsum_roll_kernel_for(qint32 blockshift);
+
+#endif // ZSYNC_ROLLING_CHECKSUM_PRIVATE_HPP_INCLUDED
@@ -42,6 +42,7 @@
 #include <QDir>
 #include <QtEndian>
 #include <QFileInfo>
+#include <QHash>
 #include <QtGlobal>
 #include <QJsonObject>
 #include <QObject>
@@ -50,6 +51,12 @@
 #include <QScopedPointer>
 #include <QElapsedTimer>
 #include <QTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QStringList>
+#include <QVector>
 #include <QTemporaryFile>
 #include <QNetworkAccessManager>
 
@@ -59,9 +66,14 @@
 #include "torrentdownloader.hpp"
 #endif
 #include "zsyncinternalstructures_p.hpp"
+#include "zsyncrollingchecksum_p.hpp"
+#include "zsyncblockranges_p.hpp"
+#include "zsyncblockwriter_p.hpp"
+#include "zsyncjournal_p.hpp"
 
 class ZsyncWriterPrivate : public QObject {
     Q_OBJECT
+    friend class QAppImageUpdateTests;
   public:
     explicit ZsyncWriterPrivate(QNetworkAccessManager*);
     ~ZsyncWriterPrivate();
@@ -69,8 +81,10 @@ class ZsyncWriterPrivate : public QObject {
     void setShowLog(bool);
     void setLoggerName(const QString&);
     void setOutputDirectory(const QString&);
+    void setSeedFiles(const QStringList&);
+    void setConcurrentRequests(int, int);
     void setConfiguration(qint32,qint32,qint32,
-                          qint32,qint32,qint32,
+                          qint32,qint32,qint64,
                           const QString&,const QString&,const QString&,
                           QUrl, QBuffer*,bool,QUrl);
     void start();
@@ -81,25 +95,33 @@ class ZsyncWriterPrivate : public QObject {
     void handleLogMessage(QString, QString);
 #endif // LOGGING_DISABLED
     void handleCancel();
-    bool verifyAndConstructTargetFile();
+    void handleSeedScanFinished(qint32, short, qint32);
+    void handleTargetFileHashed(QString, qint32);
+    void verifyAndConstructTargetFile();
     void addToRanges(zs_blockid);
     qint32 alreadyGotBlock(zs_blockid);
     qint32 buildHash();
-    qint32 checkCheckSumsOnHashChain(const hash_entry *, const unsigned char *, qint32 );
-    quint32 calcRHash(const hash_entry *const);
-    void calcMd4Checksum(unsigned char *, const unsigned char*,size_t);
-    zs_blockid getHashEntryBlockId(const hash_entry *);
+    qint32 checkCheckSumsOnHashChain(zs_blockid, const unsigned char *);
+    qint32 checkStrongCheckSums(zs_blockid, const unsigned char *, bool, unsigned char (*)[CHECKSUM_SIZE], qint32 *);
+    quint64 calcFilterHash(zs_blockid) const;
+    quint32 hashSlot(quint32) const;
+    unsigned char *blockCheckSum(zs_blockid) const;
     short tryOpenSourceFile(const QString&, QFile**);
     short parseTargetFileCheckSumBlocks();
+    template <qint32 WeakBytes>
+    void decodeCheckSumBlocks(const unsigned char*, zs_blockid);
     void writeBlocks(const unsigned char *, zs_blockid, zs_blockid);
     void removeBlockFromHash(zs_blockid);
-    qint32 submitSourceData(unsigned char*, size_t, off_t);
+    void insertBlockIntoHash(zs_blockid);
+    void compactHash();
+    qint32 submitSourceData(const unsigned char*, size_t, off_t);
     qint32 submitSourceFile(QFile*);
-    qint32 rangeBeforeBlock(zs_blockid);
     zs_blockid nextKnownBlock(zs_blockid);
     bool getBlockRanges();
-    void writeBlockRanges(qint32, qint32, QByteArray*, bool);
+    void writeBlockRanges(qint32, qint32, QByteArray*);
+    void handleRangesCoalesced(qint32, qint64, qint64);
     void writeDataSequential(QByteArray*, bool);
+    void finishWrites();
     void handleNetworkError(QNetworkReply::NetworkError);
 #ifdef DECENTRALIZED_UPDATE_ENABLED
 #if LIBTORRENT_VERSION_NUM >= 10208
@@ -112,15 +134,57 @@ class ZsyncWriterPrivate : public QObject {
     void finishedConfiguring();
     void torrentClientStarted();
     void torrentStatus(int,int);
+    void concurrentRequests(int);
     void started();
     void canceled();
+    void writesCompleted();
     void finished(QJsonObject, QString);
     void progress(int percentage, qint64 bytesReceived, qint64 bytesTotal, double speed, QString units);
     void error(short);
     void logger(QString, QString);
   private:
+    enum SeedScanResult {
+        SeedScanDone = 0,
+        SeedScanTargetExists,
+        SeedScanCanceled,
+        SeedScanError
+    };
+
+    bool isCancelRequested() const;
+#ifndef LOGGING_DISABLED
+    void log(const QString&);
+#endif // LOGGING_DISABLED
+    QStringList findSeedFiles(const QStringList&) const;
+    qint32 scanSeedFiles(const QStringList&, const QStringList&, short*);
+    qint32 submitSourceFiles(QFile*, const QStringList&);
+    qint64 estimateSeedOverlap(const unsigned char*, qint64) const;
+    QVector<QPair<qint64, qint64>> submitAlignedSource(const unsigned char*, qint64);
+    qint32 submitMappedSource(const unsigned char*, qint64, const QVector<QPair<qint64, qint64>>&);
+    qint32 submitMappedSourceParallel(const unsigned char*, qint64, const QVector<QPair<qint64, qint64>>&);
+    qint32 submitSourceStream(QFile*);
+    qint32 submitSourceFileParallel(QFile*);
+    void scanSourceChunk(const unsigned char*, qint64, qint64, QVector<zs_match>*) const;
+    qint32 mergeSourceMatches(const unsigned char*, const QVector<zs_match>&);
+    qint64 rollToCandidate(const unsigned char*, qint64, rsum*) const;
+    template <qint32 SeqMatches, unsigned short WeakCheckSumMask>
+    qint64 rollToCandidateFor(const unsigned char*, qint64, rsum*) const;
+    qint64 rollToCandidateGeneric(const unsigned char*, qint64, rsum*) const;
+    void selectRollKernels();
+    bool seedFilterContains(quint64) const;
+    void seedFilterInsert(quint64);
+    QByteArray padSeedTail(const unsigned char*, qint64);
+    bool seedScanCanceled();
+    void emitSeedProgress();
+    void recycleDataFragment(QByteArray*);
+    void writeDownloadedBlocks(const QByteArray&, zs_blockid, zs_blockid);
+    qint32 countUnknownBlocks(zs_blockid, zs_blockid) const;
+    void markBlocksWritten(zs_blockid, zs_blockid);
+    qint32 adoptJournaledFile(const QString&);
+    void saveJournal();
+    void removeJournal();
+
     bool b_Started = false,
-         b_CancelRequested = false,
+         b_Scanning = false, /* seed scan or the final hash is running on the compute thread. */
          b_AcceptRange = true,
          b_Configured = false,
          b_TorrentAvail = false;
@@ -135,33 +199,54 @@ class ZsyncWriterPrivate : public QObject {
            n_WeakCheckSumBytes = 0,
            n_StrongCheckSumBytes = 0, /* no. of bytes available for the strong checksum. */
            n_SeqMatches = 0,
-           n_Skip = 0,    /* skip forward on next submit_source_data. */
-           n_TargetFileLength = 0;
+           n_Skip = 0;    /* skip forward on next submit_source_data. */
+    qint64 n_TargetFileLength = 0;
     unsigned short p_WeakCheckSumMask = 0; /* This will be applied to the first 16 bits of the weak checksum. */
 
-    const hash_entry *p_Rover = nullptr,
-                      *p_NextMatch = nullptr;
-    zs_blockid n_NextKnown = 0;
+    /* rollToCandidate and rsum_roll specialized for the current
+     * configuration, selected once by buildHash. */
+    qint64 (ZsyncWriterPrivate::*p_RollToCandidate)(const unsigned char*, qint64, rsum*) const = nullptr;
+    rsum_roll_kernel p_RsumRoll = nullptr;
+
+    zs_blockid n_NextMatch = -1, /* block to try first on the next window, -1 if none. */
+               n_NextKnown = 0;
 
     /* Hash table for rsync algorithm */
     quint32 p_HashMask = 0;
-    hash_entry *p_BlockHashes = nullptr;
-    hash_entry **p_RsumHash = nullptr;
+    quint32 n_HashShift = 0; /* 32 - log2(no. of slots). */
+    rsum *p_BlockRsums = nullptr; /* rsum of each block. */
+    unsigned char *p_BlockCheckSums = nullptr; /* md4 of each block, n_StrongCheckSumBytes bytes apart. */
+    zs_hash_slot *p_RsumHash = nullptr;
+    qint32 n_HashEntries = 0, /* blocks in p_RsumHash, removed ones included. */
+           n_HashRemoved = 0; /* slots marked HASH_SLOT_REMOVED. */
 
-    /* And a 1-bit per rsum value table to allow fast negative lookups for hash
-     * values that don't occur in the target file. */
-    quint32 p_BitHashMask = 0;
-    unsigned char *p_BitHash = nullptr;
+    /* And a blocked bloom filter of the block rsums to allow fast negative
+     * lookups for rsums that don't occur in the target file, Each lookup
+     * only touches one cache line of 8 words. */
+    quint32 n_SeedFilterMask = 0; /* no. of filter blocks - 1. */
+    quint64 *p_SeedFilter = nullptr;
+    mutable QAtomicInteger<qint64> n_SeedFilterProbes,     /* windows checked against the filter. */
+            n_SeedFilterFalseHits; /* filter hits without a block in p_RsumHash. */
 
-    qint32 n_Ranges = 0;
-    zs_blockid *p_Ranges = nullptr; /* Ranges needed to finish the under construction target file. */
+    ZsyncBlockRanges m_KnownBlocks; /* Blocks of the under construction target file we already have. */
     QScopedPointer<QBuffer> p_TargetFileCheckSumBlocks; /* Checksum blocks that needs to be loaded into the memory.*/
-    QScopedPointer<QCryptographicHash> p_Md4Ctx; /* Md4 Hasher context.*/
     QString s_SourceFilePath,
             s_TargetFileName,
             s_TargetFileSHA1,
             s_OutputDirectory;
+    QStringList m_SeedFiles; /* extra seed files or wildcard patterns given by the user. */
+    int n_MinConcurrentRequests = 0, /* bounds of range requests in flight, 0 for the default. */
+        n_MaxConcurrentRequests = 0;
     QScopedPointer<QTemporaryFile> p_TargetFile; /* under construction target file. */
+    QScopedPointer<ZsyncBlockWriter> p_BlockWriter; /* writes to p_TargetFile, declared after it so it stops first. */
+    qint64 n_SequentialOffset = 0; /* where writeDataSequential writes next. */
+    qint32 n_PendingBlocks = 0, /* needed blocks not yet got or given up by writeBlockRanges. */
+           n_NeededRanges = 0, /* ranges of unknown blocks given to the downloader. */
+           n_RequestedRanges = 0; /* ranges the downloader asked for after merging. */
+    qint64 n_RedundantBytes = 0, /* bytes of blocks we had which were downloaded to save requests. */
+           n_GapThreshold = 0; /* largest gap in bytes the downloader merges over. */
+    QHash<zs_blockid, qint32> m_RangeRequeues; /* times a range was requested again, By the first block that failed MD4. */
+    QElapsedTimer m_JournalTimer; /* time since the journal was last saved. */
     QScopedPointer<QElapsedTimer> p_TransferSpeed;
     QScopedPointer<RangeDownloader> m_RangeDownloader;
 #ifdef DECENTRALIZED_UPDATE_ENABLED
@@ -170,10 +255,13 @@ class ZsyncWriterPrivate : public QObject {
 #endif // VERSION CHECK
 #endif // DECENTRALIZED_UPDATE_ENABLED
     QNetworkAccessManager *m_Manager;
+    QAtomicInt m_CancelToken; /* set by cancel, polled by the scan loops on any thread. */
+    qint32 n_ComputeId = 0; /* results of the compute thread from an older id are stale. */
+    int n_ScanThreads = 1; /* threads a seed scan may use, 1 scans serially. */
+    QScopedPointer<QThreadPool> p_ComputePool; /* runs the seed scan off the event loop. */
+    QScopedPointer<QThreadPool> p_VerifyPool; /* hashes large downloaded ranges. */
 #ifndef LOGGING_DISABLED
-    QString s_LogBuffer,
-            s_LoggerName;
-    QScopedPointer<QDebug> p_Logger;
+    QString s_LoggerName;
 #endif // LOGGING_DISABLED 
 };
 #endif // ZSYNC_WRITER_PRIVATE_HPP_INCLUDED
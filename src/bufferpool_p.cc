@@ -0,0 +1,52 @@
+#include "bufferpool_p.hpp"
+
+BufferPool::BufferPool(int bufferSize, int maxBuffers) {
+    n_BufferSize = bufferSize;
+    n_MaxBuffers = maxBuffers;
+}
+
+BufferPool::~BufferPool() {
+    qDeleteAll(m_Free);
+}
+
+int BufferPool::bufferSize() const {
+    return n_BufferSize;
+}
+
+/// Returns an empty buffer which can hold at least bufferSize() bytes
+/// without reallocating, The caller owns it until it is released.
+QByteArray *BufferPool::acquire() {
+    {
+        QMutexLocker locker(&m_Mutex);
+        for(int i = m_Free.size() - 1; i >= 0; --i) {
+            QByteArray *buffer = m_Free.at(i);
+            if(buffer->isDetached()) {
+                m_Free.remove(i);
+                buffer->resize(0);
+                return buffer;
+            }
+        }
+    }
+
+    QByteArray *buffer = new QByteArray;
+    buffer->reserve(n_BufferSize);
+    return buffer;
+}
+
+/// Takes back a buffer from acquire() (or any heap allocated byte array),
+/// Buffers beyond the pool size are freed.
+void BufferPool::release(QByteArray *buffer) {
+    if(!buffer) {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&m_Mutex);
+        if(m_Free.size() < n_MaxBuffers &&
+           buffer->capacity() >= n_BufferSize) {
+            m_Free.append(buffer);
+            return;
+        }
+    }
+    delete buffer;
+}
@@ -0,0 +1,155 @@
+#include "byterangesparser_p.hpp"
+
+/// Headers of a part larger than this mean a broken response.
+#define MAX_PART_HEADERS_SIZE 16384
+
+ByteRangesParser::ByteRangesParser(const QByteArray &boundary) {
+    m_Delimiter = "--" + boundary;
+    m_Part = { 0, -1, -1, QByteArray() };
+}
+
+/// Parses the next piece of the body, Returns false if the body is
+/// not a valid multipart/byteranges body.
+bool ByteRangesParser::feed(const QByteArray &data) {
+    if(m_State == Done) {
+        return true; /* Ignore the epilogue. */
+    }
+
+    if(m_State == Body && m_Pending.isEmpty()) {
+        /// Append straight to the part, The common case for large parts.
+        qint64 need = m_Part.to - m_Part.from + 1 - m_Part.data.size();
+        if(data.size() <= need) {
+            m_Part.data.append(data);
+            if(data.size() == need) {
+                m_Parts.append(m_Part);
+                m_Part = { 0, -1, -1, QByteArray() };
+                m_State = Delimiter;
+            }
+            return true;
+        }
+    }
+    m_Pending.append(data);
+    return parse();
+}
+
+/// Takes the oldest part which is complete, Returns false if there is
+/// none.
+bool ByteRangesParser::takePart(Part *part) {
+    if(m_Parts.isEmpty()) {
+        return false;
+    }
+    *part = m_Parts.takeFirst();
+    return true;
+}
+
+/// True once the closing delimiter is seen.
+bool ByteRangesParser::isFinished() const {
+    return m_State == Done;
+}
+
+bool ByteRangesParser::parse() {
+    for(;;) {
+        if(m_State == Done) {
+            m_Pending.clear();
+            return true;
+        } else if(m_State == Delimiter) {
+            int index = m_Pending.indexOf(m_Delimiter);
+            if(index < 0) {
+                /// Keep what could be the start of a split delimiter.
+                m_Pending.remove(0, qMax(0, m_Pending.size() - m_Delimiter.size() + 1));
+                return true;
+            }
+            if(m_Pending.size() < index + m_Delimiter.size() + 2) {
+                m_Pending.remove(0, index);
+                return true;
+            }
+            bool last = m_Pending.mid(index + m_Delimiter.size(), 2) == "--";
+            m_Pending.remove(0, index + m_Delimiter.size());
+            m_State = last ? Done : Headers;
+        } else if(m_State == Headers) {
+            int end = m_Pending.indexOf("\r\n\r\n");
+            if(end < 0) {
+                return m_Pending.size() <= MAX_PART_HEADERS_SIZE;
+            }
+
+            bool found = false;
+            auto lines = m_Pending.left(end).split('\n');
+            for(auto iter = lines.constBegin(); iter != lines.constEnd(); ++iter) {
+                QByteArray line = (*iter).trimmed();
+                if(line.toLower().startsWith("content-range:")) {
+                    found = parseContentRange(line.mid(14), &m_Part.from, &m_Part.to, &m_Part.total);
+                    break;
+                }
+            }
+            if(!found || m_Part.to - m_Part.from >= 0x7fffffff) {
+                return false;
+            }
+            m_Part.data.reserve((int)(m_Part.to - m_Part.from + 1));
+            m_Pending.remove(0, end + 4);
+            m_State = Body;
+        } else {
+            qint64 need = m_Part.to - m_Part.from + 1 - m_Part.data.size();
+            int take = (int)qMin<qint64>(need, m_Pending.size());
+            m_Part.data.append(m_Pending.constData(), take);
+            m_Pending.remove(0, take);
+            if(take < need) {
+                return true;
+            }
+            m_Parts.append(m_Part);
+            m_Part = { 0, -1, -1, QByteArray() };
+            m_State = Delimiter;
+        }
+    }
+}
+
+/// Returns the boundary of a multipart/byteranges Content-Type header
+/// value, Empty if it is not one.
+QByteArray ByteRangesParser::boundaryOf(const QByteArray &contentType) {
+    QByteArray lower = contentType.toLower();
+    if(!lower.trimmed().startsWith("multipart/byteranges")) {
+        return QByteArray();
+    }
+
+    int index = lower.indexOf("boundary=");
+    if(index < 0) {
+        return QByteArray();
+    }
+    QByteArray boundary = contentType.mid(index + 9);
+    int end = boundary.indexOf(';');
+    if(end >= 0) {
+        boundary.truncate(end);
+    }
+    boundary = boundary.trimmed();
+    if(boundary.size() >= 2 && boundary.startsWith('"') && boundary.endsWith('"')) {
+        boundary = boundary.mid(1, boundary.size() - 2);
+    }
+    return boundary;
+}
+
+/// Parses a Content-Range header value like "bytes 0-1023/4096" into
+/// the first and the last byte of the range, And the length of the file
+/// into total if given, -1 if it is "*".
+bool ByteRangesParser::parseContentRange(const QByteArray &value, qint64 *from, qint64 *to, qint64 *total) {
+    QByteArray range = value.trimmed();
+    if(!range.toLower().startsWith("bytes ")) {
+        return false;
+    }
+    range = range.mid(6).trimmed();
+
+    int dash = range.indexOf('-'),
+        slash = range.indexOf('/');
+    if(dash <= 0 || slash <= dash) {
+        return false;
+    }
+
+    bool ok1 = false,
+         ok2 = false;
+    *from = range.left(dash).toLongLong(&ok1);
+    *to = range.mid(dash + 1, slash - dash - 1).toLongLong(&ok2);
+    if(total) {
+        bool ok3 = false;
+        *total = range.mid(slash + 1).trimmed().toLongLong(&ok3);
+        *total = ok3 ? *total : -1;
+    }
+    return ok1 && ok2 && *from >= 0 && *to >= *from;
+}
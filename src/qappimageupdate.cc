@@ -15,6 +15,8 @@ QAppImageUpdate::QAppImageUpdate(bool singleThreaded, QObject *parent)
 	    this, &QAppImageUpdate::torrentClientStarted, Qt::DirectConnection);
     connect(s, &QAppImageUpdatePrivate::torrentStatus,
 	    this, &QAppImageUpdate::torrentStatus, Qt::DirectConnection);
+    connect(s, &QAppImageUpdatePrivate::concurrentRequests,
+	    this, &QAppImageUpdate::concurrentRequests, Qt::DirectConnection);
     connect(s, &QAppImageUpdatePrivate::started,
             this, &QAppImageUpdate::started, Qt::DirectConnection);
     connect(s, &QAppImageUpdatePrivate::canceled,
@@ -92,6 +94,20 @@ void QAppImageUpdate::setOutputDirectory(const QString &OutputDirectory) {
             Q_ARG(QString,OutputDirectory));
 }
 
+void QAppImageUpdate::setSeedFiles(const QStringList &SeedFiles) {
+    getMethod(m_Private.data(), "setSeedFiles(const QStringList&)")
+    .invoke(m_Private.data(),
+            Qt::QueuedConnection,
+            Q_ARG(QStringList,SeedFiles));
+}
+
+void QAppImageUpdate::setConcurrentRequests(int minimum, int maximum) {
+    getMethod(m_Private.data(), "setConcurrentRequests(int, int)")
+    .invoke(m_Private.data(),
+            Qt::QueuedConnection,
+            Q_ARG(int,minimum), Q_ARG(int,maximum));
+}
+
 void QAppImageUpdate::setProxy(const QNetworkProxy &Proxy) {
     getMethod(m_Private.data(), "setProxy(const QNetworkProxy&)")
     .invoke(m_Private.data(),
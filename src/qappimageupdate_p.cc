@@ -125,6 +125,11 @@ QAppImageUpdatePrivate::QAppImageUpdatePrivate(bool singleThreaded, QObject *par
     connect(m_DeltaWriter.data(), &ZsyncWriterPrivate::torrentStatus,
             this, &QAppImageUpdatePrivate::torrentStatus,
             (Qt::ConnectionType)(Qt::DirectConnection | Qt::UniqueConnection));
+
+    // Range Downloader Specific
+    connect(m_DeltaWriter.data(), &ZsyncWriterPrivate::concurrentRequests,
+            this, &QAppImageUpdatePrivate::concurrentRequests,
+            (Qt::ConnectionType)(Qt::DirectConnection | Qt::UniqueConnection));
 }
 
 QAppImageUpdatePrivate::QAppImageUpdatePrivate(const QString &AppImagePath, bool singleThreaded, QObject *parent)
@@ -232,6 +237,30 @@ void QAppImageUpdatePrivate::setOutputDirectory(const QString &dir) {
     return;
 }
 
+void QAppImageUpdatePrivate::setSeedFiles(const QStringList &seeds) {
+    if(b_Started || b_Running) {
+        return;
+    }
+
+    getMethod(m_DeltaWriter.data(), "setSeedFiles(const QStringList&)")
+    .invoke(m_DeltaWriter.data(),
+            Qt::QueuedConnection,
+            Q_ARG(QStringList, seeds));
+    return;
+}
+
+void QAppImageUpdatePrivate::setConcurrentRequests(int minimum, int maximum) {
+    if(b_Started || b_Running) {
+        return;
+    }
+
+    getMethod(m_DeltaWriter.data(), "setConcurrentRequests(int, int)")
+    .invoke(m_DeltaWriter.data(),
+            Qt::QueuedConnection,
+            Q_ARG(int, minimum), Q_ARG(int, maximum));
+    return;
+}
+
 void QAppImageUpdatePrivate::setProxy(const QNetworkProxy &proxy) {
     if(b_Started || b_Running) {
         return;
@@ -845,7 +874,11 @@ void QAppImageUpdatePrivate::handleUpdateFinished(QJsonObject info, QString oldV
         {"NewVersionPath", info["AbsolutePath"].toString()},
         {"NewVersionSha1Hash", info["Sha1Hash"].toString()},
         {"UsedTorrent", info["UsedTorrent"].toBool()},
-	{"TorrentFileUrl", info["TorrentFileUrl"].toString()}
+	{"TorrentFileUrl", info["TorrentFileUrl"].toString()},
+        {"NeededRanges", info["NeededRanges"].toInt()},
+        {"RequestedRanges", info["RequestedRanges"].toInt()},
+        {"RedundantBytes", info["RedundantBytes"].toDouble()},
+        {"CoalesceGapThreshold", info["CoalesceGapThreshold"].toDouble()}
     };
     b_Started = b_Running = false;
     b_Finished = true;
@@ -1591,6 +1624,9 @@ QString QAppImageUpdatePrivate::errorCodeToString(short errorCode) {
     case QAppImageUpdateEnums::Error::TargetFileSha1HashMismatch:
         ret += "TargetFileSha1HashMismatch";
         break;
+    case QAppImageUpdateEnums::Error::CannotWriteTargetFile:
+        ret += "CannotWriteTargetFile";
+        break;
     case QAppImageUpdateEnums::Error::TorrentNotSupported:
 	ret += "TorrentNotSupported";
 	break;
@@ -1791,6 +1827,9 @@ QString QAppImageUpdatePrivate::errorCodeToDescriptionString(short errorCode) {
     case QAppImageUpdateEnums::Error::TargetFileSha1HashMismatch:
         errorString = QString::fromUtf8("The newly constructed AppImage failed the integrity check, please try again.");
         break;
+    case QAppImageUpdateEnums::Error::CannotWriteTargetFile:
+        errorString = QString::fromUtf8("Cannot write the new version of the AppImage to the disk.");
+        break;
     case QAppImageUpdateEnums::Error::TorrentNotSupported:
 	errorString = QString::fromUtf8("The AppImage author does not support decentralized update.");
 	break;
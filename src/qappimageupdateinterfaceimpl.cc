@@ -13,6 +13,8 @@ QAppImageUpdateInterfaceImpl::QAppImageUpdateInterfaceImpl(QObject *parent)
     connect(s, &QAppImageUpdate::torrentStatus,
             this, &QAppImageUpdateInterfaceImpl::torrentStatus, 
 	    Qt::DirectConnection);
+    connect(s, &QAppImageUpdate::concurrentRequests,
+            this, &QAppImageUpdateInterfaceImpl::concurrentRequests, Qt::DirectConnection);
     connect(s, &QAppImageUpdate::started,
             this, &QAppImageUpdateInterfaceImpl::started, Qt::DirectConnection);
     connect(s, &QAppImageUpdate::canceled,
@@ -60,6 +62,14 @@ void QAppImageUpdateInterfaceImpl::setOutputDirectory(const QString &a) {
     m_Private->setOutputDirectory(a);
 }
 
+void QAppImageUpdateInterfaceImpl::setSeedFiles(const QStringList &a) {
+    m_Private->setSeedFiles(a);
+}
+
+void QAppImageUpdateInterfaceImpl::setConcurrentRequests(int minimum, int maximum) {
+    m_Private->setConcurrentRequests(minimum, maximum);
+}
+
 void QAppImageUpdateInterfaceImpl::setProxy(const QNetworkProxy &a) {
     m_Private->setProxy(a);
 }
@@ -1,10 +1,12 @@
 #include "rangedownloader.hpp"
 #include "rangedownloader_p.hpp"
+#include "bufferpool_p.hpp"
 #include "helpers_p.hpp"
 
 RangeDownloader::RangeDownloader(QNetworkAccessManager *manager, QObject *parent)
     : QObject(parent) {
-    m_Private = QSharedPointer<RangeDownloaderPrivate>(new RangeDownloaderPrivate(manager));
+    m_BufferPool = QSharedPointer<BufferPool>(new BufferPool);
+    m_Private = QSharedPointer<RangeDownloaderPrivate>(new RangeDownloaderPrivate(manager, m_BufferPool));
     auto obj = m_Private.data();
 
     connect(obj, &RangeDownloaderPrivate::started,
@@ -31,12 +33,26 @@ RangeDownloader::RangeDownloader(QNetworkAccessManager *manager, QObject *parent
             this, &RangeDownloader::rangeData,
             Qt::DirectConnection);
 
+    connect(obj, &RangeDownloaderPrivate::rangesCoalesced,
+            this, &RangeDownloader::rangesCoalesced,
+            Qt::DirectConnection);
+
+    connect(obj, &RangeDownloaderPrivate::concurrentRequests,
+            this, &RangeDownloader::concurrentRequests,
+            Qt::DirectConnection);
+
     connect(obj, &RangeDownloaderPrivate::progress,
             this, &RangeDownloader::progress,
             Qt::DirectConnection);
 }
 
 
+/// Gives a fragment from the data signal back to the buffer pool,
+/// Safe to call from any thread.
+void RangeDownloader::recycle(QByteArray *fragment) {
+    m_BufferPool->release(fragment);
+}
+
 void RangeDownloader::setBlockSize(qint32 blockSize) {
     getMethod(m_Private.data(), "setBlockSize(qint32)")
     .invoke(m_Private.data(),
@@ -55,11 +71,11 @@ void RangeDownloader::setTargetFileUrl(const QUrl &url) {
 
 }
 
-void RangeDownloader::setTargetFileLength(qint32 n) {
-    getMethod(m_Private.data(), "setTargetFileLength(qint32)")
+void RangeDownloader::setTargetFileLength(qint64 n) {
+    getMethod(m_Private.data(), "setTargetFileLength(qint64)")
     .invoke(m_Private.data(),
             Qt::QueuedConnection,
-            Q_ARG(qint32,n));
+            Q_ARG(qint64,n));
 }
 
 void RangeDownloader::setBytesWritten(qint64 n) {
@@ -69,6 +85,12 @@ void RangeDownloader::setBytesWritten(qint64 n) {
             Q_ARG(qint64,n));
 }
 
+void RangeDownloader::setConcurrentRequests(int minimum, int maximum) {
+    getMethod(m_Private.data(), "setConcurrentRequests(int,int)")
+    .invoke(m_Private.data(),
+            Qt::QueuedConnection,
+            Q_ARG(int,minimum), Q_ARG(int,maximum));
+}
 
 void RangeDownloader::setFullDownload(bool choice) {
     getMethod(m_Private.data(), "setFullDownload(bool)")
@@ -84,6 +106,13 @@ void RangeDownloader::appendRange(qint32 from, qint32 to) {
             Q_ARG(qint32,from), Q_ARG(qint32,to));
 }
 
+void RangeDownloader::requeueRange(qint32 from, qint32 to) {
+    getMethod(m_Private.data(), "requeueRange(qint32,qint32)")
+    .invoke(m_Private.data(),
+            Qt::QueuedConnection,
+            Q_ARG(qint32,from), Q_ARG(qint32,to));
+}
+
 void RangeDownloader::start() {
     getMethod(m_Private.data(), "start()")
     .invoke(m_Private.data(),
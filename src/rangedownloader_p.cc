@@ -3,9 +3,32 @@
 
 #include "rangedownloader_p.hpp"
 
-RangeDownloaderPrivate::RangeDownloaderPrivate(QNetworkAccessManager *manager, QObject *parent)
+/// The most ranges asked for in one multi range request, Keeps the
+/// Range header well under the header size limits of servers.
+#define MULTI_RANGE_MAX_RANGES 32
+
+/// The url check reads this much of the target file to measure the
+/// throughput which decides how far apart ranges are merged.
+#define COALESCE_PROBE_BYTES (64 * 1024)
+
+/// Never merge ranges over a larger gap, However fast the link is.
+#define COALESCE_MAX_GAP_BYTES (4 * 1024 * 1024)
+
+/// Default bounds of the no. of range requests in flight, See adaptWindow.
+#define WINDOW_DEFAULT_MIN 1
+#define WINDOW_DEFAULT_MAX 32
+
+/// A reply slower than this many times the fastest one so far means the
+/// requests are queueing somewhere.
+#define WINDOW_LATENCY_INFLATION 2
+
+RangeDownloaderPrivate::RangeDownloaderPrivate(QNetworkAccessManager *manager,
+        const QSharedPointer<BufferPool> &pool, QObject *parent)
     : QObject(parent) {
     m_Manager = manager;
+    m_BufferPool = pool;
+    n_MinWindow = WINDOW_DEFAULT_MIN;
+    n_MaxWindow = WINDOW_DEFAULT_MAX;
     m_Manager->clearAccessCache();
 }
 
@@ -39,7 +62,17 @@ void RangeDownloaderPrivate::setTargetFileUrl(const QUrl &url) {
     m_Url = url;
 }
 
-void RangeDownloaderPrivate::setTargetFileLength(qint32 len) {
+/// Bounds of the no. of range requests in flight, The window moves
+/// between them with the network.
+void RangeDownloaderPrivate::setConcurrentRequests(int minimum, int maximum) {
+    if(b_Running || minimum < 1 || maximum < minimum) {
+        return;
+    }
+    n_MinWindow = minimum;
+    n_MaxWindow = maximum;
+}
+
+void RangeDownloaderPrivate::setTargetFileLength(qint64 len) {
     if(b_Running) {
         return;
     }
@@ -75,6 +108,17 @@ void RangeDownloaderPrivate::start() {
     }
     b_Running = b_Finished = false;
     n_Active = -1;
+    m_PendingParts.clear();
+    n_Rtt = n_ProbeSpeed = 0;
+    n_ProbeFrom = n_ProbeStart = -1;
+    n_RequestedRanges = 0;
+    n_RedundantBytes = 0;
+    n_Window = qBound(n_MinWindow, QThread::idealThreadCount() * 2, n_MaxWindow);
+    n_WindowAcks = 0;
+    n_MinLatency = n_EpochLatency = n_LastGoodput = 0;
+    n_LastDecrease = -1;
+    m_ReplyStart.clear();
+    m_ElapsedTimer.start();
 
     QNetworkRequest request;
 
@@ -118,8 +162,8 @@ QNetworkRequest RangeDownloaderPrivate::makeRangeRequest(const QUrl &url, const
     request.setUrl(url);
     if(range.first || range.second) {
 
-        auto fromRange = range.first * n_BlockSize;
-        auto toRange = range.second * n_BlockSize;
+        qint64 fromRange = (qint64)range.first * n_BlockSize;
+        qint64 toRange = (qint64)range.second * n_BlockSize;
 
 
         QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(fromRange) + "-";
@@ -130,6 +174,25 @@ QNetworkRequest RangeDownloaderPrivate::makeRangeRequest(const QUrl &url, const
     return request;
 }
 
+/// Request for more than one range of blocks at once, The server answers
+/// with a multipart/byteranges body.
+QNetworkRequest RangeDownloaderPrivate::makeMultiRangeRequest(const QUrl &url, const QVector<QPair<qint32, qint32>> &ranges) {
+    QNetworkRequest request;
+
+    request.setUrl(url);
+    QByteArray rangeHeaderValue = "bytes=";
+    for(auto iter = ranges.constBegin(); iter != ranges.constEnd(); ++iter) {
+        if(iter != ranges.constBegin()) {
+            rangeHeaderValue += ",";
+        }
+        rangeHeaderValue += QByteArray::number((qint64)(*iter).first * n_BlockSize) + "-";
+        rangeHeaderValue += QByteArray::number((qint64)(*iter).second * n_BlockSize);
+    }
+    request.setRawHeader("Range", rangeHeaderValue);
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    return request;
+}
+
 
 // Slots which does the url check routine
 void RangeDownloaderPrivate::handleUrlCheckError(QNetworkReply::NetworkError code) {
@@ -145,9 +208,6 @@ void RangeDownloaderPrivate::handleUrlCheckError(QNetworkReply::NetworkError cod
 }
 
 void RangeDownloaderPrivate::handleUrlCheck(qint64 br, qint64 bt) {
-    Q_UNUSED(br);
-    Q_UNUSED(bt);
-
     auto reply = qobject_cast<QNetworkReply*>(QObject::sender());
     if(!reply) {
         return;
@@ -157,6 +217,22 @@ void RangeDownloaderPrivate::handleUrlCheck(qint64 br, qint64 bt) {
         return;
     }
 
+    /// For range downloads keep reading a little to know the round trip
+    /// time and the throughput of the link, See gapThreshold.
+    if(n_ProbeFrom < 0) {
+        n_Rtt = qMax<qint64>(m_ElapsedTimer.elapsed(), 1);
+        n_ProbeFrom = br;
+        n_ProbeStart = m_ElapsedTimer.elapsed();
+    }
+    if(!b_FullDownload) {
+        reply->readAll();
+        if(br - n_ProbeFrom < COALESCE_PROBE_BYTES && (bt < 0 || br < bt)) {
+            return;
+        }
+        qint64 elapsed = qMax<qint64>(m_ElapsedTimer.elapsed() - n_ProbeStart, 1);
+        n_ProbeSpeed = (br - n_ProbeFrom) * 1000 / elapsed;
+    }
+
     m_Url = reply->url();
 
     reply->disconnect();
@@ -176,7 +252,8 @@ void RangeDownloaderPrivate::handleUrlCheck(qint64 br, qint64 bt) {
         /// Full download just launch a single RangeReply object.
         ++n_Active;
         auto range = qMakePair<qint32,qint32>(0,0);
-        auto rangeReply = new RangeReply(n_Active, m_Manager->get(makeRangeRequest(m_Url, range)), range);
+        auto rangeReply = new RangeReply(n_Active, m_Manager->get(makeRangeRequest(m_Url, range)), range,
+                                         m_BufferPool);
 
         connect(rangeReply, SIGNAL(canceled(int)),
                 this, SLOT(handleRangeReplyCancel(int)),
@@ -207,46 +284,12 @@ void RangeDownloaderPrivate::handleUrlCheck(qint64 br, qint64 bt) {
         return;
     }
 
-    // Now we will determine the maximum no. of requests to be handled at
-    // a time.
-    int max_allowed = QThread::idealThreadCount() * 2;
-    int i = n_Done;
-
-    for(; i < m_RequiredBlocks.size(); ++i) {
-        if(n_Active + 1 >= max_allowed) {
-            break;
-        }
-
-        auto range = m_RequiredBlocks.at(i);
-
-        QNetworkRequest request = makeRangeRequest(m_Url, range);
-        ++n_Active;
-
-        auto rangeReply = new RangeReply(n_Active, m_Manager->get(request), range);
-
-        connect(rangeReply, SIGNAL(canceled(int)),
-                this, SLOT(handleRangeReplyCancel(int)),
-                Qt::QueuedConnection);
-
-        connect(rangeReply, SIGNAL(restarted(int)),
-                this, SLOT(handleRangeReplyRestart(int)),
-                Qt::QueuedConnection);
-
-        connect(rangeReply, SIGNAL(error(QNetworkReply::NetworkError, int,bool)),
-                this, SLOT(handleRangeReplyError(QNetworkReply::NetworkError, int,bool)),
-                Qt::QueuedConnection);
-
-        connect(rangeReply, SIGNAL(finished(qint32,qint32, QByteArray*, int)),
-                this, SLOT(handleRangeReplyFinished(qint32,qint32, QByteArray*, int)),
-                Qt::QueuedConnection);
-
-        connect(rangeReply, SIGNAL(progress(qint64, int)),
-                this, SLOT(handleRangeReplyProgress(qint64, int)),
-                Qt::QueuedConnection);
-
-        m_ActiveRequests.append(rangeReply);
-    }
-    n_Done = i;
+    /// The no. of requests in flight starts at what used to be the fixed
+    //  limit and follows the network from then on, See adaptWindow.
+    n_EpochStart = m_ElapsedTimer.elapsed();
+    n_EpochBytes = 0;
+    emit concurrentRequests(n_Window);
+    fillWindow();
 }
 
 /// ----
@@ -264,8 +307,7 @@ void RangeDownloaderPrivate::handleRangeReplyCancel(int index) {
 
 
 void RangeDownloaderPrivate::handleRangeReplyRestart(int index) {
-    Q_UNUSED(index);
-
+    m_ReplyStart[index] = m_ElapsedTimer.elapsed();
 }
 
 void RangeDownloaderPrivate::handleRangeReplyError(QNetworkReply::NetworkError code, int index, bool threshReached) {
@@ -280,7 +322,22 @@ void RangeDownloaderPrivate::handleRangeReplyError(QNetworkReply::NetworkError c
         return;
     }
 
+    /// The server or the path to it is overloaded, Back off.
+    if(code == QNetworkReply::ServiceUnavailableError ||
+            code == QNetworkReply::TimeoutError ||
+            code == QNetworkReply::RemoteHostClosedError) {
+        shrinkWindow();
+    }
 
+    /// A multi range request is not retried as a whole, The ranges
+    /// it did not get go back in the queue as single ranges which are.
+    if(m_PendingParts.contains(index)) {
+        (m_ActiveRequests.at(index))->destroy();
+        m_ActiveRequests[index] = nullptr;
+        requeuePendingParts(index);
+        startNextRangeReply(index);
+        return;
+    }
 
     /// Let's try to retry some type of errors.
     /// We don't try to retry a full download, if it
@@ -334,9 +391,62 @@ void RangeDownloaderPrivate::handleRangeReplyFinished(qint32 from, qint32 to, QB
     if(b_FullDownload) {
         emit data(Data, true);
         return;
+    }
+
+    const qint64 latency = m_ElapsedTimer.elapsed() - m_ReplyStart.take(index);
+    if(m_PendingParts.contains(index)) {
+        /// A multi range reply, Its parts are already out.
+        requeuePendingParts(index);
     } else {
-        bool isLast = (n_Done >= m_RequiredBlocks.size() && n_Active - 1 == -1);
-        emit rangeData(from, to,  Data, isLast);
+        emit rangeData(from, to, Data);
+    }
+
+    startNextRangeReply(index);
+    adaptWindow(latency);
+}
+
+/// A part of a multi range reply is here.
+void RangeDownloaderPrivate::handleRangeReplyPart(qint32 from, qint32 to, QByteArray *Data, int index) {
+    if(b_CancelRequested || !m_PendingParts.contains(index)) {
+        delete Data;
+        return;
+    }
+    /// A short part only serves the start of its range, The rest stays
+    /// pending and is asked for again when the reply is done.
+    auto &pending = m_PendingParts[index];
+    for(auto iter = pending.begin(); iter != pending.end(); ++iter) {
+        if(iter->first != from) {
+            continue;
+        }
+        if(iter->second == to) {
+            pending.erase(iter);
+        } else {
+            iter->first = to;
+        }
+        break;
+    }
+    emit rangeData(from, to, Data);
+}
+
+/// Puts the ranges of a multi range reply which the server did not send
+/// back in the queue, As single ranges from now on since the server does
+/// not serve multiple ranges well.
+void RangeDownloaderPrivate::requeuePendingParts(int index) {
+    auto ranges = m_PendingParts.take(index);
+    if(ranges.isEmpty()) {
+        return;
+    }
+    b_MultiRange = false;
+    m_RequiredBlocks += ranges;
+}
+
+/// Starts the reply for the next ranges in the queue in the place of the
+/// reply at index, Finishes the download if there is nothing left.
+void RangeDownloaderPrivate::startNextRangeReply(int index) {
+    /// The window shrunk, Retire this slot.
+    if(n_Done < m_RequiredBlocks.size() && n_Active + 1 > n_Window) {
+        --n_Active;
+        return;
     }
 
     if(n_Done >= m_RequiredBlocks.size()) {
@@ -349,10 +459,154 @@ void RangeDownloaderPrivate::handleRangeReplyFinished(qint32 from, qint32 to, QB
         return;
     }
 
-    auto range = m_RequiredBlocks.at(n_Done++);
-    QNetworkRequest request = makeRangeRequest(m_Url, range);
-    auto rangeReply = new RangeReply(index, m_Manager->get(request), range);
-    m_ActiveRequests[index] = rangeReply;
+    m_ActiveRequests[index] = startRangeReply(index, takeRanges());
+}
+
+/// Starts replies in the free slots until the window is full or there
+/// is nothing left to ask for.
+void RangeDownloaderPrivate::fillWindow() {
+    while(n_Done < m_RequiredBlocks.size() && n_Active + 1 < n_Window) {
+        int index = m_ActiveRequests.indexOf(nullptr);
+        if(index < 0) {
+            index = m_ActiveRequests.size();
+            m_ActiveRequests.append(nullptr);
+        }
+        ++n_Active;
+        m_ActiveRequests[index] = startRangeReply(index, takeRanges());
+    }
+}
+
+/// Additive increase of the window, Once per window of finished replies.
+/// The window grows by one unless the replies were queueing without
+/// any gain in goodput, In which case it shrinks.
+void RangeDownloaderPrivate::adaptWindow(qint64 latency) {
+    if(!b_Running) {
+        return;
+    }
+    const qint64 now = m_ElapsedTimer.elapsed();
+    latency = qMax<qint64>(latency, 1);
+    n_MinLatency = n_MinLatency ? qMin(n_MinLatency, latency) : latency;
+    n_EpochLatency = qMax(n_EpochLatency, latency);
+
+    if(++n_WindowAcks < n_Window) {
+        return;
+    }
+
+    const qint64 goodput = (n_RecievedBytes - n_EpochBytes) * 1000 / qMax<qint64>(now - n_EpochStart, 1);
+    const bool queueing = n_EpochLatency > n_MinLatency * WINDOW_LATENCY_INFLATION;
+    if(queueing && goodput <= n_LastGoodput) {
+        shrinkWindow();
+    } else if(n_Window < n_MaxWindow) {
+        ++n_Window;
+        emit concurrentRequests(n_Window);
+        fillWindow();
+    }
+
+    n_LastGoodput = goodput;
+    n_WindowAcks = 0;
+    n_EpochLatency = 0;
+    n_EpochStart = now;
+    n_EpochBytes = n_RecievedBytes;
+}
+
+/// Multiplicative decrease of the window, At most once per round trip so
+/// the errors of one burst count once. Replies over the window finish
+/// and their slots are not used again, See startNextRangeReply.
+void RangeDownloaderPrivate::shrinkWindow() {
+    const qint64 now = m_ElapsedTimer.elapsed();
+    if(n_LastDecrease >= 0 && now - n_LastDecrease < qMax<qint64>(n_MinLatency, n_Rtt)) {
+        return;
+    }
+    n_LastDecrease = now;
+    n_WindowAcks = 0;
+
+    int window = qMax(n_MinWindow, n_Window / 2);
+    if(window != n_Window) {
+        n_Window = window;
+        emit concurrentRequests(n_Window);
+    }
+}
+
+/// Takes the next ranges to ask for in one request from the queue, Spread
+/// over the parallel requests and at most MULTI_RANGE_MAX_RANGES.
+/// Ranges in the queue which are closer than gapThreshold are merged into
+/// one, Downloading the blocks between them again is cheaper than one
+/// more range to ask for.
+QVector<QPair<qint32, qint32>> RangeDownloaderPrivate::takeRanges() {
+    QVector<QPair<qint32, qint32>> ranges;
+    int count = 1;
+    if(b_MultiRange) {
+        int left = m_RequiredBlocks.size() - n_Done;
+        count = qBound(1, left / n_Window, MULTI_RANGE_MAX_RANGES);
+    }
+    const qint64 threshold = gapThreshold();
+    while(n_Done < m_RequiredBlocks.size() && ranges.size() < count) {
+        auto range = m_RequiredBlocks.at(n_Done++);
+        while(n_Done < m_RequiredBlocks.size()) {
+            const auto &next = m_RequiredBlocks.at(n_Done);
+            qint64 gap = (qint64)(next.first - range.second) * n_BlockSize;
+            if(next.first < range.second || gap > threshold) {
+                break;
+            }
+            range.second = next.second;
+            n_RedundantBytes += gap;
+            ++n_Done;
+        }
+        ranges.append(range);
+    }
+    n_RequestedRanges += ranges.size();
+    emit rangesCoalesced(n_RequestedRanges, n_RedundantBytes, threshold);
+    return ranges;
+}
+
+/// The largest gap in bytes worth downloading to save a range, The bytes
+/// the link moves in one round trip. The throughput of the download
+/// itself is used once there is enough of it.
+qint64 RangeDownloaderPrivate::gapThreshold() const {
+    qint64 speed = n_ProbeSpeed;
+    if(n_RecievedBytes >= COALESCE_PROBE_BYTES && m_ElapsedTimer.elapsed() > 0) {
+        speed = n_RecievedBytes * 1000 / m_ElapsedTimer.elapsed();
+    }
+    return qMin<qint64>(n_Rtt * speed / 1000, COALESCE_MAX_GAP_BYTES);
+}
+
+/// Requests a range again, Used when the data got for the range was
+/// corrupted. If every reply is already done then a new reply is started
+/// for it, Else the next reply to finish takes it.
+void RangeDownloaderPrivate::requeueRange(qint32 from, qint32 to) {
+    if(b_FullDownload || b_CancelRequested) {
+        return;
+    }
+
+    m_RequiredBlocks.append(qMakePair<qint32, qint32>(from, to));
+    if(n_Active >= 0 || !b_Finished) {
+        return;
+    }
+
+    b_Running = true;
+    b_Finished = false;
+    m_ActiveRequests.clear();
+    fillWindow();
+}
+
+/// Starts a reply for the given ranges of a partial download, Its signals
+/// carry the given index. More than one range goes out as a single
+/// multi range request.
+RangeReply *RangeDownloaderPrivate::startRangeReply(int index, const QVector<QPair<qint32, qint32>> &ranges) {
+    RangeReply *rangeReply = nullptr;
+    m_ReplyStart[index] = m_ElapsedTimer.elapsed();
+    if(ranges.size() > 1) {
+        QNetworkRequest request = makeMultiRangeRequest(m_Url, ranges);
+        rangeReply = new RangeReply(index, m_Manager->get(request), ranges, n_BlockSize);
+        m_PendingParts.insert(index, ranges);
+
+        connect(rangeReply, SIGNAL(part(qint32, qint32, QByteArray*, int)),
+                this, SLOT(handleRangeReplyPart(qint32, qint32, QByteArray*, int)),
+                Qt::QueuedConnection);
+    } else {
+        QNetworkRequest request = makeRangeRequest(m_Url, ranges.at(0));
+        rangeReply = new RangeReply(index, m_Manager->get(request), ranges.at(0));
+    }
 
     connect(rangeReply, SIGNAL(canceled(int)),
             this, SLOT(handleRangeReplyCancel(int)),
@@ -373,8 +627,7 @@ void RangeDownloaderPrivate::handleRangeReplyFinished(qint32 from, qint32 to, QB
     connect(rangeReply, SIGNAL(progress(qint64, int)),
             this, SLOT(handleRangeReplyProgress(qint64, int)),
             Qt::QueuedConnection);
-
-
+    return rangeReply;
 }
 
 void RangeDownloaderPrivate::handleRangeReplyProgress(qint64 bytesRc, int index) {
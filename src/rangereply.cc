@@ -4,11 +4,25 @@
 
 #include <QCoreApplication>
 
-RangeReply::RangeReply(int index, QNetworkReply *reply, const QPair<qint32, qint32> &range)
+RangeReply::RangeReply(int index, QNetworkReply *reply, const QPair<qint32, qint32> &range,
+                       const QSharedPointer<BufferPool> &pool)
     : QObject() {
     m_Private = QSharedPointer<RangeReplyPrivate>(
-                    new RangeReplyPrivate(index, reply, range));
+                    new RangeReplyPrivate(index, reply, range, pool));
+    connectPrivate();
+}
 
+/// A reply to a multi range request for the given block ranges, Emits
+/// part for each range as soon as it is got.
+RangeReply::RangeReply(int index, QNetworkReply *reply, const QVector<QPair<qint32, qint32>> &ranges,
+                       qint32 blockSize)
+    : QObject() {
+    m_Private = QSharedPointer<RangeReplyPrivate>(
+                    new RangeReplyPrivate(index, reply, ranges, blockSize));
+    connectPrivate();
+}
+
+void RangeReply::connectPrivate() {
     auto ptr = m_Private.data();
     connect(ptr, &RangeReplyPrivate::restarted,
             this, &RangeReply::restarted,
@@ -19,6 +33,9 @@ RangeReply::RangeReply(int index, QNetworkReply *reply, const QPair<qint32, qint
     connect(ptr, &RangeReplyPrivate::finished,
             this, &RangeReply::finished,
             Qt::DirectConnection);
+    connect(ptr, &RangeReplyPrivate::part,
+            this, &RangeReply::part,
+            Qt::DirectConnection);
     connect(ptr, &RangeReplyPrivate::data,
             this, &RangeReply::data,
             Qt::DirectConnection);
@@ -28,7 +45,6 @@ RangeReply::RangeReply(int index, QNetworkReply *reply, const QPair<qint32, qint
     connect(ptr, &RangeReplyPrivate::progress,
             this, &RangeReply::progress,
             Qt::DirectConnection);
-
 }
 
 RangeReply::~RangeReply() {
@@ -5,7 +5,8 @@
 /// is not severe.
 #define FAIL_THRESHOLD 50
 
-RangeReplyPrivate::RangeReplyPrivate(int index, QNetworkReply *reply, const QPair<qint32, qint32> &blockRange) {
+RangeReplyPrivate::RangeReplyPrivate(int index, QNetworkReply *reply, const QPair<qint32, qint32> &blockRange,
+                                     const QSharedPointer<BufferPool> &pool) {
     n_Index = index;
     n_BytesRecieved = 0;
     n_FromBlock = blockRange.first;
@@ -17,6 +18,8 @@ RangeReplyPrivate::RangeReplyPrivate(int index, QNetworkReply *reply, const QPai
     m_Reply.reset(reply);
     if(!b_FullDownload) {
         m_Data.reset(new QByteArray);
+    } else {
+        m_BufferPool = pool.isNull() ? QSharedPointer<BufferPool>(new BufferPool) : pool;
     }
     m_Timer.setSingleShot(true);
 
@@ -34,6 +37,17 @@ RangeReplyPrivate::RangeReplyPrivate(int index, QNetworkReply *reply, const QPai
             this, SLOT(restart()));
 }
 
+/// A multi range request, The reply is answered part by part through
+/// the part signal and finished carries no data.
+RangeReplyPrivate::RangeReplyPrivate(int index, QNetworkReply *reply, const QVector<QPair<qint32, qint32>> &ranges,
+                                     qint32 blockSize)
+    : RangeReplyPrivate(index, reply, ranges.first(), QSharedPointer<BufferPool>()) {
+    n_FromBlock = n_ToBlock = 0;
+    n_BlockSize = blockSize;
+    m_Ranges = ranges;
+    b_MultiRange = true;
+}
+
 RangeReplyPrivate::~RangeReplyPrivate() {
     if(b_Halted) {
         return;
@@ -127,6 +141,11 @@ void RangeReplyPrivate::restart() {
 
     resetInternalFlags();
 
+    if(b_MultiRange) {
+        m_Parser.reset();
+        m_Data->clear();
+        b_SinglePart = false;
+    }
     m_Reply.reset(m_Manager->get(m_Request));
 
     auto reply = m_Reply.data();
@@ -166,12 +185,16 @@ void RangeReplyPrivate::handleData(qint64 bytesRec, qint64 bytesTotal) {
     }
 
     if(m_Reply->isOpen() && m_Reply->isReadable()) {
-        if(!b_FullDownload) {
+        if(b_MultiRange) {
+            if(!b_Finished && startParts()) {
+                handleParts(m_Reply->readAll());
+            }
+        } else if(!b_FullDownload) {
             m_Data->append(m_Reply->readAll());
         } else {
-            QByteArray *datafrag = new QByteArray;
-            datafrag->append(m_Reply->readAll());
-            emit data(datafrag, false);
+            while(m_Reply->bytesAvailable() > 0) {
+                emit data(readFragment(), false);
+            }
         }
 
     }
@@ -195,6 +218,12 @@ void RangeReplyPrivate::handleError(QNetworkReply::NetworkError code) {
         emit canceled(n_Index);
         return;
     }
+    /// Qt has no code of its own for too many requests, It is retried
+    /// like service unavailable and the downloader backs off for both.
+    if(!m_Reply.isNull() &&
+            m_Reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 429) {
+        code = QNetworkReply::ServiceUnavailableError;
+    }
     resetInternalFlags();
     ++n_Fails;
     bool thresholdReached = (n_Fails > FAIL_THRESHOLD);
@@ -204,7 +233,7 @@ void RangeReplyPrivate::handleError(QNetworkReply::NetworkError code) {
 }
 
 void RangeReplyPrivate::handleFinish() {
-    if(b_Halted || b_Canceled) {
+    if(b_Halted || b_Canceled || (b_MultiRange && b_Finished)) {
         return;
     }
 
@@ -221,6 +250,19 @@ void RangeReplyPrivate::handleFinish() {
     resetInternalFlags();
     b_Finished = true;
 
+    if(b_MultiRange) {
+        /// On a fallback the reply is already finished.
+        if(!startParts() || !handleParts(m_Reply->readAll())) {
+            return;
+        }
+        if(b_SinglePart) {
+            servePart(n_SinglePartOffset, *m_Data, n_SinglePartTotal);
+        }
+        m_Reply->disconnect();
+        emit finished(0, 0, nullptr, n_Index);
+        return;
+    }
+
     /// Append any data that is left.
     if(!b_FullDownload) {
         m_Data->append(m_Reply->readAll());
@@ -230,9 +272,126 @@ void RangeReplyPrivate::handleFinish() {
     if(!b_FullDownload) {
         emit finished(n_FromBlock, n_ToBlock, m_Data.take(), n_Index);
     } else {
-        QByteArray *datafrag = new QByteArray;
-        datafrag->append(m_Reply->readAll());
-        emit finished(n_FromBlock, n_ToBlock, datafrag, n_Index);
+        while(m_Reply->bytesAvailable() > m_BufferPool->bufferSize()) {
+            emit data(readFragment(), false);
+        }
+        emit finished(n_FromBlock, n_ToBlock, readFragment(), n_Index);
     }
     m_Reply->disconnect();
 }
+
+/// Reads at most one pool buffer worth of data from the reply straight
+/// into a buffer from the pool, The receiver releases it to the pool.
+QByteArray *RangeReplyPrivate::readFragment() {
+    QByteArray *fragment = m_BufferPool->acquire();
+    qint64 length = qMin<qint64>(m_Reply->bytesAvailable(), fragment->capacity());
+    if(length <= 0) {
+        return fragment;
+    }
+    fragment->resize(static_cast<int>(length));
+    length = m_Reply->read(fragment->data(), length);
+    fragment->resize(static_cast<int>(qMax<qint64>(length, 0)));
+    return fragment;
+}
+
+/// Looks at the headers of a multi range reply once, Returns false if the
+/// server did not answer with the ranges, In which case the reply is
+/// finished without any parts and the ranges are asked again one by one.
+bool RangeReplyPrivate::startParts() {
+    if(!m_Parser.isNull() || b_SinglePart) {
+        return true;
+    }
+    if(b_Halted) {
+        return false;
+    }
+
+    int status = m_Reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(status == 206) {
+        QByteArray boundary = ByteRangesParser::boundaryOf(m_Reply->rawHeader("Content-Type"));
+        if(!boundary.isEmpty()) {
+            m_Parser.reset(new ByteRangesParser(boundary));
+            return true;
+        }
+
+        /// Some servers merge ranges that are close into a single one.
+        qint64 from = 0,
+               to = 0;
+        if(ByteRangesParser::parseContentRange(m_Reply->rawHeader("Content-Range"), &from, &to, &n_SinglePartTotal)) {
+            b_SinglePart = true;
+            n_SinglePartOffset = from;
+            return true;
+        }
+    }
+
+    fallback();
+    return false;
+}
+
+/// Returns false if the body is malformed, In which case the reply
+/// falls back like startParts does.
+bool RangeReplyPrivate::handleParts(const QByteArray &data) {
+    if(b_SinglePart) {
+        m_Data->append(data);
+        return true;
+    }
+
+    if(!m_Parser->feed(data)) {
+        fallback();
+        return false;
+    }
+
+    ByteRangesParser::Part got;
+    while(m_Parser->takePart(&got)) {
+        servePart(got.from, got.data, got.total);
+    }
+    return true;
+}
+
+/// Emits every range we asked for that starts inside the given bytes of
+/// a file of length total, -1 if unknown.
+/// A range the bytes end in before the end of the file is only served up
+/// to its last whole block, The rest stays in m_Ranges and the downloader
+/// asks for it again.
+void RangeReplyPrivate::servePart(qint64 from, const QByteArray &data, qint64 total) {
+    qint64 to = from + data.size() - 1;
+    for(auto iter = m_Ranges.begin(); iter != m_Ranges.end();) {
+        qint64 start = static_cast<qint64>(iter->first) * n_BlockSize,
+               end = static_cast<qint64>(iter->second) * n_BlockSize;
+        if(start < from || start > to) {
+            ++iter;
+            continue;
+        }
+
+        qint32 served = iter->second;
+        if(to < end - 1 && to + 1 != total) {
+            served = iter->first + static_cast<qint32>((to + 1 - start) / n_BlockSize);
+            if(served == iter->first) {
+                ++iter;
+                continue;
+            }
+        }
+
+        qint64 length = qMin(static_cast<qint64>(served) * n_BlockSize - 1, to) - start + 1;
+        QByteArray *rangeData = (start == from && length == data.size()) ?
+                                new QByteArray(data) :
+                                new QByteArray(data.constData() + (start - from), static_cast<int>(length));
+        emit part(iter->first, served, rangeData, n_Index);
+        if(served == iter->second) {
+            iter = m_Ranges.erase(iter);
+        } else {
+            iter->first = served;
+            ++iter;
+        }
+    }
+}
+
+/// The server cannot do multi range requests, Stop and let the
+/// downloader ask for whatever is left.
+void RangeReplyPrivate::fallback() {
+    m_Reply->disconnect();
+    m_Reply->abort();
+    m_Parser.reset();
+    resetInternalFlags();
+    b_Finished = true;
+    emit finished(0, 0, nullptr, n_Index);
+}
@@ -0,0 +1,103 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncblockranges_p.cc
+ * @description : Set of the target file blocks we already have.
+*/
+#include "zsyncblockranges_p.hpp"
+
+void ZsyncBlockRanges::clear() {
+    m_Ranges.clear();
+}
+
+/* Marks the given block as known. */
+void ZsyncBlockRanges::add(zs_blockid x) {
+    add(x, x);
+}
+
+/* Marks the blocks [from, to] as known, merging with the ranges it
+ * overlaps or adjoins. */
+void ZsyncBlockRanges::add(zs_blockid from, zs_blockid to) {
+    if (to < from) {
+        return;
+    }
+
+    auto iter = m_Ranges.upperBound(from);
+    if (iter != m_Ranges.begin()) {
+        auto prev = iter;
+        --prev;
+        if (prev.value() >= to) {
+            /* Already have all of these blocks */
+            return;
+        }
+        if (prev.value() + 1 >= from) {
+            /* Adjoins or overlaps the range below, extend it */
+            from = prev.key();
+            iter = m_Ranges.erase(prev);
+        }
+    }
+
+    /* Swallow all the ranges above that we overlap or adjoin */
+    while (iter != m_Ranges.end() && iter.key() <= to + 1) {
+        to = qMax(to, iter.value());
+        iter = m_Ranges.erase(iter);
+    }
+    m_Ranges.insert(from, to);
+}
+
+/* Returns true if the given block is known. */
+bool ZsyncBlockRanges::contains(zs_blockid x) const {
+    auto iter = m_Ranges.upperBound(x);
+    if (iter == m_Ranges.constBegin()) {
+        return false;
+    }
+    --iter;
+    return x <= iter.value();
+}
+
+/* Returns x if the block x is known, else the first known block after x,
+ * Or end if there is no known block after x. */
+zs_blockid ZsyncBlockRanges::nextKnown(zs_blockid x, zs_blockid end) const {
+    if (contains(x)) {
+        return x;
+    }
+    auto iter = m_Ranges.upperBound(x);
+    return iter == m_Ranges.constEnd() ? end : iter.key();
+}
+
+/* Returns the no. of disjoint ranges of known blocks. */
+qint32 ZsyncBlockRanges::count() const {
+    return m_Ranges.size();
+}
+
+bool ZsyncBlockRanges::isEmpty() const {
+    return m_Ranges.isEmpty();
+}
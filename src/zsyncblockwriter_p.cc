@@ -0,0 +1,224 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncblockwriter_p.cc
+ * @description : Writes the blocks of the target file on its own thread.
+*/
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "zsyncblockwriter_p.hpp"
+
+/* Writers wait when this many bytes are queued, So a fast seed scan
+ * cannot pile up copies of the seed in memory. */
+static constexpr qint64 BLOCK_WRITER_MAX_QUEUED = 67108864;
+/* Longer writes are queued in pieces of this size, So a single write
+ * cannot go over the limit above or the int length of a QByteArray. */
+static constexpr qint64 BLOCK_WRITER_MAX_ITEM = 16777216;
+static_assert(BLOCK_WRITER_MAX_ITEM <= BLOCK_WRITER_MAX_QUEUED, "an item must fit in the queue");
+/* Upper bound on the no. of buffers written by one pwritev. */
+static constexpr int BLOCK_WRITER_MAX_IOV = 256;
+
+ZsyncBlockWriter::ZsyncBlockWriter(int fd, qint64 length)
+    : QThread(),
+      m_Hasher(length) {
+    n_Fd = fd;
+}
+
+ZsyncBlockWriter::~ZsyncBlockWriter() {
+    {
+        QMutexLocker locker(&m_Mutex);
+        b_Stop = true;
+        m_Queued.wakeAll();
+    }
+    wait();
+}
+
+/* Allocates the disk space for the whole target file up front, Returns
+ * false if the file system cannot do it which is not fatal. */
+bool ZsyncBlockWriter::preallocate(qint64 length) {
+    if (length <= 0) {
+        return true;
+    }
+    return posix_fallocate(n_Fd, 0, length) == 0;
+}
+
+/* Queues a copy of data[0 .. length - 1] to be written at offset, Each
+ * piece is copied only when there is room for it in the queue. */
+void ZsyncBlockWriter::write(qint64 offset, const unsigned char *data, qint64 length) {
+    for (qint64 done = 0; done < length; done += BLOCK_WRITER_MAX_ITEM) {
+        const qint64 n = qMin(length - done, BLOCK_WRITER_MAX_ITEM);
+        if (!waitForRoom(n)) {
+            return;
+        }
+        enqueue({ offset + done, QByteArray((const char*)data + done, (int)n), 0, n });
+    }
+}
+
+/* Queues data[from .. from + length - 1] to be written at offset, The
+ * buffer is shared and not copied. */
+void ZsyncBlockWriter::write(qint64 offset, const QByteArray &data, qint64 from, qint64 length) {
+    length = qMin(length, (qint64)data.size() - from);
+    for (qint64 done = 0; done < length; done += BLOCK_WRITER_MAX_ITEM) {
+        enqueue({ offset + done, data, from + done, qMin(length - done, BLOCK_WRITER_MAX_ITEM) });
+    }
+}
+
+/* Blocks until everything queued so far is written, Returns false if any
+ * write failed. */
+bool ZsyncBlockWriter::flush() {
+    QMutexLocker locker(&m_Mutex);
+    while (!m_Queue.isEmpty() || b_Busy) {
+        m_Drained.wait(&m_Mutex);
+    }
+    return n_Error == 0;
+}
+
+/* The hasher fed with the written data, Only valid to use after flush. */
+ZsyncPrefixHasher *ZsyncBlockWriter::hasher() {
+    return &m_Hasher;
+}
+
+/* Blocks until length more bytes fit in the queue, Returns false if the
+ * writer is stopping. */
+bool ZsyncBlockWriter::waitForRoom(qint64 length) {
+    QMutexLocker locker(&m_Mutex);
+    while (n_QueuedBytes > 0 && n_QueuedBytes + length > BLOCK_WRITER_MAX_QUEUED && !b_Stop) {
+        m_Drained.wait(&m_Mutex);
+    }
+    return !b_Stop;
+}
+
+/* Waits for room again, As another thread may have queued since the
+ * caller did. */
+void ZsyncBlockWriter::enqueue(Item item) {
+    QMutexLocker locker(&m_Mutex);
+    while (n_QueuedBytes > 0 && n_QueuedBytes + item.length > BLOCK_WRITER_MAX_QUEUED && !b_Stop) {
+        m_Drained.wait(&m_Mutex);
+    }
+    n_QueuedBytes += item.length;
+    m_Queue.append(item);
+    m_Queued.wakeAll();
+}
+
+void ZsyncBlockWriter::run() {
+    QVector<Item> items;
+    for (;;) {
+        {
+            QMutexLocker locker(&m_Mutex);
+            while (m_Queue.isEmpty() && !b_Stop) {
+                m_Queued.wait(&m_Mutex);
+            }
+            if (m_Queue.isEmpty()) {
+                return;
+            }
+            items.swap(m_Queue);
+            b_Busy = true;
+        }
+
+        qint64 bytes = 0;
+        for (const Item &item : items) {
+            bytes += item.length;
+        }
+        bool ok = writeItems(&items);
+        int error = ok ? 0 : errno;
+        if (ok) {
+            for (const Item &item : items) {
+                m_Hasher.update(item.offset, item.data, item.from, item.length);
+            }
+        }
+        items.clear();
+
+        QMutexLocker locker(&m_Mutex);
+        if (!ok && n_Error == 0) {
+            n_Error = error ? error : EIO;
+        }
+        n_QueuedBytes -= bytes;
+        b_Busy = false;
+        m_Drained.wakeAll();
+    }
+}
+
+/* Writes the given items, Runs of items adjacent in the file go out in
+ * one pwritev. */
+bool ZsyncBlockWriter::writeItems(QVector<Item> *items) {
+    std::sort(items->begin(), items->end(), [](const Item &a, const Item &b) {
+        return a.offset < b.offset;
+    });
+
+    struct iovec iov[BLOCK_WRITER_MAX_IOV];
+    int i = 0;
+    while (i < items->size()) {
+        const qint64 offset = items->at(i).offset;
+        qint64 total = 0;
+        int n = 0;
+        while (i < items->size() && n < BLOCK_WRITER_MAX_IOV
+                && items->at(i).offset == offset + total) {
+            const Item &item = items->at(i);
+            iov[n].iov_base = (void*)(item.data.constData() + item.from);
+            iov[n].iov_len = (size_t)item.length;
+            total += item.length;
+            ++n;
+            ++i;
+        }
+
+        /* Write the run, Resuming after short writes. */
+        struct iovec *cur = iov;
+        qint64 done = 0;
+        while (done < total) {
+            ssize_t r = pwritev(n_Fd, cur, n, offset + done);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (r == 0) {
+                errno = EIO;
+                return false;
+            }
+            done += r;
+            while (n > 0 && (size_t)r >= cur->iov_len) {
+                r -= cur->iov_len;
+                ++cur;
+                --n;
+            }
+            if (n > 0) {
+                cur->iov_base = (char*)cur->iov_base + r;
+                cur->iov_len -= r;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,128 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncjournal_p.cc
+ * @description : Sidecar journal of the verified blocks of a partial target file.
+*/
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+
+#include "zsyncjournal_p.hpp"
+
+/* 'ZSJL' */
+static constexpr quint32 JOURNAL_MAGIC = 0x5A534A4C;
+static constexpr quint32 JOURNAL_VERSION = 1;
+
+ZsyncJournal::ZsyncJournal(const QString &targetFileSHA1, qint64 targetFileLength,
+                           qint32 blockSize, qint32 blocks) {
+    s_TargetFileSHA1 = targetFileSHA1;
+    n_TargetFileLength = targetFileLength;
+    n_BlockSize = blockSize;
+    n_Blocks = blocks;
+}
+
+/* Returns the path of the journal for the given .part file. */
+QString ZsyncJournal::pathOf(const QString &partFilePath) {
+    return partFilePath + ".journal";
+}
+
+/* Atomically replaces the journal at path with the given known blocks,
+ * Returns false if it cannot be written. */
+bool ZsyncJournal::save(const QString &path, const ZsyncBlockRanges &known) const {
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << JOURNAL_MAGIC << JOURNAL_VERSION
+           << s_TargetFileSHA1 << n_TargetFileLength << n_BlockSize << n_Blocks
+           << known.count();
+    known.forEachRange([&stream](zs_blockid first, zs_blockid last) {
+        stream << (qint32)first << (qint32)last;
+    });
+
+    if(stream.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+/* Reads the known blocks from the journal at path into known, Returns
+ * false if there is no journal, it is damaged or it is for some other
+ * target. */
+bool ZsyncJournal::load(const QString &path, ZsyncBlockRanges *known) const {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0,
+            version = 0;
+    QString targetFileSHA1;
+    qint64 targetFileLength = 0;
+    qint32 blockSize = 0,
+           blocks = 0,
+           count = 0;
+    stream >> magic >> version;
+    if(magic != JOURNAL_MAGIC || version != JOURNAL_VERSION) {
+        return false;
+    }
+    stream >> targetFileSHA1 >> targetFileLength >> blockSize >> blocks >> count;
+    if(stream.status() != QDataStream::Ok ||
+            targetFileSHA1 != s_TargetFileSHA1 ||
+            targetFileLength != n_TargetFileLength ||
+            blockSize != n_BlockSize ||
+            blocks != n_Blocks ||
+            count < 0) {
+        return false;
+    }
+
+    known->clear();
+    for(qint32 i = 0; i < count; ++i) {
+        qint32 first = 0,
+               last = 0;
+        stream >> first >> last;
+        if(stream.status() != QDataStream::Ok ||
+                first < 0 || last < first || last >= n_Blocks) {
+            known->clear();
+            return false;
+        }
+        known->add(first, last);
+    }
+    return true;
+}
@@ -0,0 +1,248 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncmd4_p.cc
+ * @description : Scalar and multi buffer MD4 (RFC 1320) implementations.
+*/
+#include <cstring>
+
+#include "zsyncmd4_p.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MD4_X86
+#endif
+
+/*
+ * All the round functions are written once against a generic word type V,
+ * Which is quint32 for the single buffer path and a GCC vector of 4 or 8
+ * quint32 for the multi buffer paths where lane i hashes message i.
+*/
+typedef quint32 md4_v4 __attribute__((vector_size(16)));
+typedef quint32 md4_v8 __attribute__((vector_size(32)));
+
+#define MD4_ROTL(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+#define MD4_F(x, y, z) (((x) & (y)) | (~(x) & (z)))
+#define MD4_G(x, y, z) (((x) & (y)) | ((x) & (z)) | ((y) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define MD4_R1(a, b, c, d, k, s) a = MD4_ROTL(a + MD4_F(b, c, d) + X[k], s)
+#define MD4_R2(a, b, c, d, k, s) a = MD4_ROTL(a + MD4_G(b, c, d) + X[k] + 0x5A827999u, s)
+#define MD4_R3(a, b, c, d, k, s) a = MD4_ROTL(a + MD4_H(b, c, d) + X[k] + 0x6ED9EBA1u, s)
+
+template <typename V>
+static inline __attribute__((always_inline)) void md4_compress(V *state, const V *X) {
+    V a = state[0], b = state[1], c = state[2], d = state[3];
+
+    for (int k = 0; k < 16; k += 4) {
+        MD4_R1(a, b, c, d, k + 0, 3);
+        MD4_R1(d, a, b, c, k + 1, 7);
+        MD4_R1(c, d, a, b, k + 2, 11);
+        MD4_R1(b, c, d, a, k + 3, 19);
+    }
+    for (int k = 0; k < 4; ++k) {
+        MD4_R2(a, b, c, d, k + 0, 3);
+        MD4_R2(d, a, b, c, k + 4, 5);
+        MD4_R2(c, d, a, b, k + 8, 9);
+        MD4_R2(b, c, d, a, k + 12, 13);
+    }
+    static const int order[4] = { 0, 2, 1, 3 };
+    for (int i = 0; i < 4; ++i) {
+        int k = order[i];
+        MD4_R3(a, b, c, d, k + 0, 3);
+        MD4_R3(d, a, b, c, k + 8, 9);
+        MD4_R3(c, d, a, b, k + 4, 11);
+        MD4_R3(b, c, d, a, k + 12, 15);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+static inline quint32 md4_load_le32(const unsigned char *p) {
+    return (quint32)p[0] | ((quint32)p[1] << 8) | ((quint32)p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+static inline void md4_store_le32(unsigned char *p, quint32 v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/*
+ * Writes the MD4 padding for a message of len bytes whose last
+ * len % 64 bytes are at tail into pad, Returns the no. of 64 byte
+ * blocks in pad (1 or 2).
+*/
+static inline int md4_pad_tail(const unsigned char *tail, size_t len, unsigned char *pad) {
+    size_t rem = len & 63;
+    int blocks = (rem < 56) ? 1 : 2;
+    memset(pad, 0, 128);
+    memcpy(pad, tail, rem);
+    pad[rem] = 0x80;
+    quint64 bits = (quint64)len << 3;
+    for (int i = 0; i < 8; ++i) {
+        pad[blocks * 64 - 8 + i] = (unsigned char)(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+void md4_digest(const unsigned char *data, size_t len, unsigned char *digest) {
+    quint32 state[4] = { 0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u };
+    quint32 X[16];
+
+    size_t full = len >> 6;
+    for (size_t blk = 0; blk < full; ++blk) {
+        const unsigned char *p = data + (blk << 6);
+        for (int k = 0; k < 16; ++k) {
+            X[k] = md4_load_le32(p + 4 * k);
+        }
+        md4_compress(state, X);
+    }
+
+    unsigned char pad[128];
+    int blocks = md4_pad_tail(data + (full << 6), len, pad);
+    for (int blk = 0; blk < blocks; ++blk) {
+        for (int k = 0; k < 16; ++k) {
+            X[k] = md4_load_le32(pad + 64 * blk + 4 * k);
+        }
+        md4_compress(state, X);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        md4_store_le32(digest + 4 * i, state[i]);
+    }
+}
+
+/*
+ * Hashes LANES messages at once, Each message word is gathered from the
+ * lanes into one vector, So the compression runs once for all lanes.
+*/
+template <typename V, int LANES>
+static inline __attribute__((always_inline)) void md4_digest_lanes(const unsigned char *const *data, size_t len,
+        unsigned char *digests) {
+    V state[4];
+    V X[16];
+    for (int l = 0; l < LANES; ++l) {
+        state[0][l] = 0x67452301u;
+        state[1][l] = 0xEFCDAB89u;
+        state[2][l] = 0x98BADCFEu;
+        state[3][l] = 0x10325476u;
+    }
+
+    size_t full = len >> 6;
+    for (size_t blk = 0; blk < full; ++blk) {
+        for (int k = 0; k < 16; ++k) {
+            for (int l = 0; l < LANES; ++l) {
+                X[k][l] = md4_load_le32(data[l] + (blk << 6) + 4 * k);
+            }
+        }
+        md4_compress(state, X);
+    }
+
+    /* All the messages have the same length, So the no. of padding blocks is
+     * the same in every lane. */
+    unsigned char pad[LANES][128];
+    int blocks = 0;
+    for (int l = 0; l < LANES; ++l) {
+        blocks = md4_pad_tail(data[l] + (full << 6), len, pad[l]);
+    }
+    for (int blk = 0; blk < blocks; ++blk) {
+        for (int k = 0; k < 16; ++k) {
+            for (int l = 0; l < LANES; ++l) {
+                X[k][l] = md4_load_le32(pad[l] + 64 * blk + 4 * k);
+            }
+        }
+        md4_compress(state, X);
+    }
+
+    for (int l = 0; l < LANES; ++l) {
+        for (int i = 0; i < 4; ++i) {
+            md4_store_le32(digests + CHECKSUM_SIZE * l + 4 * i, state[i][l]);
+        }
+    }
+}
+
+static void md4_digest_x4(const unsigned char *const *data, size_t len, unsigned char *digests) {
+    md4_digest_lanes<md4_v4, 4>(data, len, digests);
+}
+
+#ifdef MD4_X86
+__attribute__((target("avx2")))
+static void md4_digest_x8(const unsigned char *const *data, size_t len, unsigned char *digests) {
+    md4_digest_lanes<md4_v8, 8>(data, len, digests);
+}
+#endif // MD4_X86
+
+struct md4_many_dispatch {
+    const char *name;
+    qint32 lanes;
+};
+
+static md4_many_dispatch select_md4_many_kernel() {
+#ifdef MD4_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return { "avx2 x8", 8 };
+    }
+    return { "sse2 x4", 4 };
+#else
+    return { "generic x4", 4 };
+#endif // MD4_X86
+}
+
+static const md4_many_dispatch &md4_many_selected() {
+    static const md4_many_dispatch selected = select_md4_many_kernel();
+    return selected;
+}
+
+void md4_digest_many(const unsigned char *const *data, size_t len, qint32 n, unsigned char *digests) {
+    qint32 i = 0;
+#ifdef MD4_X86
+    if (md4_many_selected().lanes == 8) {
+        for (; i + 8 <= n; i += 8) {
+            md4_digest_x8(data + i, len, digests + CHECKSUM_SIZE * i);
+        }
+    }
+#endif // MD4_X86
+    for (; i + 4 <= n; i += 4) {
+        md4_digest_x4(data + i, len, digests + CHECKSUM_SIZE * i);
+    }
+    for (; i < n; ++i) {
+        md4_digest(data[i], len, digests + CHECKSUM_SIZE * i);
+    }
+}
+
+const char *md4_digest_many_kernel_name() {
+    return md4_many_selected().name;
+}
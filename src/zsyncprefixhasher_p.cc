@@ -0,0 +1,131 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncprefixhasher_p.cc
+ * @description : SHA-1 of the target file computed as its contiguous prefix is written.
+*/
+#include "zsyncprefixhasher_p.hpp"
+
+/* Bytes of out of order data held until the prefix reaches them. */
+static constexpr qint64 PREFIX_HASHER_MAX_PENDING = 16777216;
+
+ZsyncPrefixHasher::ZsyncPrefixHasher(qint64 length)
+    : m_Hash(QCryptographicHash::Sha1) {
+    n_Length = length;
+}
+
+/* Takes data[from .. from + length - 1] written at offset in the target
+ * file. The buffer is shared and not copied. */
+void ZsyncPrefixHasher::update(qint64 offset, const QByteArray &data, qint64 from, qint64 length) {
+    /* Anything past the end of the target is padding of the last block. */
+    length = qMin(length, n_Length - offset);
+    if(length <= 0 || offset + length <= n_Prefix) {
+        return;
+    }
+
+    if(offset <= n_Prefix) {
+        consume(offset, data.constData() + from, length);
+        drain();
+        return;
+    }
+
+    auto iter = m_Pending.find(offset);
+    if(iter != m_Pending.end()) {
+        if((*iter).length >= length) {
+            return;
+        }
+        n_PendingBytes -= (*iter).length;
+        m_Pending.erase(iter);
+    }
+
+    /* Make room by dropping the data farthest from the prefix, Never the
+     * data which is nearer than the new one. */
+    while(n_PendingBytes + length > PREFIX_HASHER_MAX_PENDING && !m_Pending.isEmpty()) {
+        auto last = m_Pending.end() - 1;
+        if(last.key() < offset) {
+            return;
+        }
+        n_PendingBytes -= (*last).length;
+        m_Pending.erase(last);
+    }
+    if(length > PREFIX_HASHER_MAX_PENDING) {
+        return;
+    }
+    m_Pending.insert(offset, { data, from, length });
+    n_PendingBytes += length;
+}
+
+/* Hashes data which continues the prefix, Used to hash the tail read back
+ * from the file. */
+void ZsyncPrefixHasher::addData(const QByteArray &data) {
+    consume(n_Prefix, data.constData(), qMin((qint64)data.size(), n_Length - n_Prefix));
+}
+
+/* No. of bytes from the start of the target file hashed so far. */
+qint64 ZsyncPrefixHasher::prefix() const {
+    return n_Prefix;
+}
+
+QByteArray ZsyncPrefixHasher::result() {
+    m_Pending.clear();
+    n_PendingBytes = 0;
+    return m_Hash.result();
+}
+
+/* Hashes data[0 .. length - 1] at offset, Skipping the bytes already
+ * covered by the prefix. */
+void ZsyncPrefixHasher::consume(qint64 offset, const char *data, qint64 length) {
+    qint64 skip = n_Prefix - offset;
+    if(skip >= length) {
+        return;
+    }
+    data += skip;
+    length -= skip;
+    while(length > 0) {
+        int n = (int)qMin<qint64>(length, 1073741824);
+        m_Hash.addData(data, n);
+        data += n;
+        length -= n;
+        n_Prefix += n;
+    }
+}
+
+/* Hashes the pending data the prefix has reached. */
+void ZsyncPrefixHasher::drain() {
+    while(!m_Pending.isEmpty() && m_Pending.firstKey() <= n_Prefix) {
+        auto first = m_Pending.begin();
+        Pending pending = *first;
+        qint64 offset = first.key();
+        n_PendingBytes -= pending.length;
+        m_Pending.erase(first);
+        consume(offset, pending.data.constData() + pending.from, pending.length);
+    }
+}
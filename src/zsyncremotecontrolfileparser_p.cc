@@ -35,6 +35,7 @@
  * zsync control file and produce us with a more sensible data to work with.
  * This also produces information for ZsyncWriterPrivate.
 */
+#include <limits>
 #include <QFileInfo>
 
 #include "zsyncremotecontrolfileparser_p.hpp"
@@ -325,16 +326,16 @@ void ZsyncRemoteControlFileParserPrivate::getZsyncInformation(void) {
         return;
     }
 
+    /*
+     * Hand over a read only view of the checksum blocks, The buffer shares
+     * the data of the control file and starts at the offset of the checksum
+     * blocks, So nothing is copied.
+    */
     auto buffer = new QBuffer;
     QString SeedFilePath = (j_UpdateInformation["FileInformation"].toObject())["AppImageFilePath"].toString();
-    buffer->open(QIODevice::WriteOnly);
-    p_ControlFile->seek(n_CheckSumBlocksOffset); /* Seek to the offset of the checksum block. */
-
-    while(!p_ControlFile->atEnd()) {
-        buffer->write(p_ControlFile->read((n_WeakCheckSumBytes + n_StrongCheckSumBytes) * 16));
-        QCoreApplication::processEvents();
-    }
-    buffer->close();
+    buffer->setData(p_ControlFile->data());
+    buffer->open(QIODevice::ReadOnly);
+    buffer->seek(n_CheckSumBlocksOffset);
     /* leave the buffer ownership to the one who called it. */
     emit zsyncInformation(n_TargetFileBlockSize, n_TargetFileBlocks, n_WeakCheckSumBytes, n_StrongCheckSumBytes,
                           n_ConsecutiveMatchNeeded, n_TargetFileLength, SeedFilePath, s_TargetFileName,
@@ -542,45 +543,26 @@ void ZsyncRemoteControlFileParserPrivate::handleControlFile(void) {
     disconnect(senderReply, SIGNAL(downloadProgress(qint64, qint64)),
                this, SLOT(handleDownloadProgress(qint64, qint64)));
 
-    p_ControlFile.reset(new QBuffer);
-    p_ControlFile->open(QIODevice::ReadWrite);
-
     /*
      * Since QNetworkReply is sequential QIODevice , We cannot seek but we
-     * need to seek on command for future operation so we copy everything
-     * to our newly allocated QIODevice and Also find the offset on the way.
-     * Since this is sequential , We cannot use *->pos() to get the current position
-     * of the file pointer , Therefore we will use a temporary variable.
+     * need to seek on command for future operation so we take everything
+     * to our newly allocated QIODevice at once and then find the offset
+     * of the checksum blocks, The marker for it is the first \n\n.
+     *
+     * Therefore,
+     *
+     * ZsyncHeaders = (0 , offset - 2)
+     * Checksums = (offset , EOF)
      */
     {
         INFO_START LOGR " handleControlFile : searching for checksum blocks offset in the zsync control file." INFO_END;
-        qint64 pos = 0;
-        char previousMark = 0;
-        int bufferSize = 1;
-        while(!senderReply->atEnd()) {
-            /*
-             * Read one byte at a time , Since the marker for the
-             * offset of the checksum blocks is \n\n.
-             *
-             * Therefore,
-             *
-             * ZsyncHeaders = (0 , offset - 2)
-             * Checksums = (offset , EOF)
-            */
-            QByteArray data = senderReply->read(bufferSize);
-            pos += bufferSize;
-            if(bufferSize < 1024 && previousMark == 10 && data.at(0) == 10) {
-                /*
-                 * Set the offset and increase the buffer size
-                 * to finish the rest of the copy faster.
-                */
-                INFO_START LOGR " handleControlFile : found checksum blocks offset(" LOGR pos LOGR ") in zsync control file." INFO_END;
-                n_CheckSumBlocksOffset = pos;
-                bufferSize = 1024; /* Use standard size of 1024 bytes. */
-            } else {
-                previousMark = data.at(0);
-            }
-            p_ControlFile->write(data);
+        p_ControlFile.reset(new QBuffer);
+        p_ControlFile->setData(senderReply->readAll());
+        p_ControlFile->open(QIODevice::ReadOnly);
+        qint64 marker = p_ControlFile->data().indexOf("\n\n");
+        if(marker >= 0) {
+            n_CheckSumBlocksOffset = marker + 2;
+            INFO_START LOGR " handleControlFile : found checksum blocks offset(" LOGR n_CheckSumBlocksOffset LOGR ") in zsync control file." INFO_END;
         }
     }
     senderReply->deleteLater();
@@ -679,9 +661,9 @@ void ZsyncRemoteControlFileParserPrivate::handleControlFile(void) {
     {
         QString nStr;
         STORE_SPLIT(nStr, ZsyncHeaderList.at(4), "Length: ", QAppImageUpdateEnums::Error::InvalidTargetFileLength);
-        n_TargetFileLength =  nStr.toInt();
+        n_TargetFileLength =  nStr.toLongLong();
     }
-    if(n_TargetFileLength == 0) {
+    if(n_TargetFileLength <= 0) {
         emit error(QAppImageUpdateEnums::Error::InvalidTargetFileLength);
         return;
     }
@@ -727,7 +709,14 @@ void ZsyncRemoteControlFileParserPrivate::handleControlFile(void) {
     s_TargetFileSHA1 = s_TargetFileSHA1.toUpper();
     INFO_START LOGR " handleControlFile : zsync target file sha1 hash is confirmed to be " LOGR s_TargetFileSHA1 LOGR "." INFO_END;
 
-    n_TargetFileBlocks = (n_TargetFileLength + n_TargetFileBlockSize - 1) / n_TargetFileBlockSize;
+    {
+        qint64 blocks = (n_TargetFileLength + n_TargetFileBlockSize - 1) / n_TargetFileBlockSize;
+        if(blocks > std::numeric_limits<qint32>::max()) {
+            emit error(QAppImageUpdateEnums::Error::InvalidTargetFileLength);
+            return;
+        }
+        n_TargetFileBlocks = (qint32)blocks;
+    }
     INFO_START LOGR " handleControlFile : zsync target file has " LOGR n_TargetFileBlocks LOGR " number of blocks." INFO_END;
 
     /*
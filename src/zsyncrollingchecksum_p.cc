@@ -0,0 +1,226 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2018-2019, Antony jr
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @filename    : zsyncrollingchecksum_p.cc
+ * @description : Scalar, SSE4.1 and AVX2 implementations of rsum_roll.
+*/
+#include "zsyncrollingchecksum_p.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RSUM_ROLL_X86
+#endif
+
+/*
+ * The rolling update for one position is,
+ *
+ * 	a(x+1) = a(x) + data[x + blocksize] - data[x]
+ * 	b(x+1) = b(x) + a(x+1) - (data[x] << blockshift)
+ *
+ * So the a values of consecutive windows are a prefix sum of the byte
+ * differences and the b values are a prefix sum over the a values, Both
+ * in 16 bit arithmetic. The vector kernels compute these prefix sums for
+ * 8 or 16 windows at a time with log2(lanes) shift and add steps.
+ *
+ * Every kernel is a template over the block shift, SHIFT 0 takes the block
+ * size and shift from the arguments while the others have them built in.
+*/
+
+template <qint32 SHIFT>
+static void rsum_roll_scalar(const unsigned char *data, qint32 blocksize, qint32 blockshift,
+                             rsum r, qint32 n, unsigned short *a, unsigned short *b) {
+    if (SHIFT) {
+        blocksize = 1 << SHIFT;
+        blockshift = SHIFT;
+    }
+    unsigned short ra = r.a,
+                   rb = r.b;
+    for (qint32 k = 0; k < n; ++k) {
+        unsigned char oc = data[k];
+        unsigned char nc = data[k + blocksize];
+        ra += nc - oc;
+        rb += ra - (oc << blockshift);
+        a[k] = ra;
+        b[k] = rb;
+    }
+}
+
+#ifdef RSUM_ROLL_X86
+__attribute__((target("sse4.1")))
+static inline __m128i prefix_sum_epi16(__m128i v) {
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+    return v;
+}
+
+/* Broadcasts the last 16 bit lane to all lanes. */
+__attribute__((target("sse4.1")))
+static inline __m128i broadcast_last_epi16(__m128i v) {
+    v = _mm_shufflehi_epi16(v, 0xFF);
+    return _mm_unpackhi_epi64(v, v);
+}
+
+template <qint32 SHIFT>
+__attribute__((target("sse4.1")))
+static void rsum_roll_sse41(const unsigned char *data, qint32 blocksize, qint32 blockshift,
+                            rsum r, qint32 n, unsigned short *a, unsigned short *b) {
+    if (SHIFT) {
+        blocksize = 1 << SHIFT;
+        blockshift = SHIFT;
+    }
+    const __m128i shift = _mm_cvtsi32_si128(blockshift);
+    __m128i va = _mm_set1_epi16((short)r.a),
+            vb = _mm_set1_epi16((short)r.b);
+    qint32 k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m128i oc = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(data + k)));
+        __m128i nc = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(data + k + blocksize)));
+
+        __m128i na = _mm_add_epi16(va, prefix_sum_epi16(_mm_sub_epi16(nc, oc)));
+        __m128i nb = _mm_add_epi16(vb, prefix_sum_epi16(_mm_sub_epi16(na, _mm_sll_epi16(oc, shift))));
+
+        _mm_storeu_si128((__m128i*)(a + k), na);
+        _mm_storeu_si128((__m128i*)(b + k), nb);
+        va = broadcast_last_epi16(na);
+        vb = broadcast_last_epi16(nb);
+    }
+
+    if (k < n) {
+        if (k) {
+            r.a = a[k - 1];
+            r.b = b[k - 1];
+        }
+        rsum_roll_scalar<SHIFT>(data + k, blocksize, blockshift, r, n - k, a + k, b + k);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i prefix_sum_epi16_avx2(__m256i v) {
+    /* Prefix sum in each 128 bit lane, then carry the low lane into the high lane. */
+    v = _mm256_add_epi16(v, _mm256_slli_si256(v, 2));
+    v = _mm256_add_epi16(v, _mm256_slli_si256(v, 4));
+    v = _mm256_add_epi16(v, _mm256_slli_si256(v, 8));
+    __m256i carry = _mm256_permute2x128_si256(v, v, 0x08);
+    carry = _mm256_shufflehi_epi16(carry, 0xFF);
+    carry = _mm256_unpackhi_epi64(carry, carry);
+    return _mm256_add_epi16(v, carry);
+}
+
+/* Broadcasts the last 16 bit lane to all lanes. */
+__attribute__((target("avx2")))
+static inline __m256i broadcast_last_epi16_avx2(__m256i v) {
+    v = _mm256_permute4x64_epi64(v, 0xFF);
+    v = _mm256_shufflelo_epi16(v, 0xFF);
+    return _mm256_shufflehi_epi16(v, 0xFF);
+}
+
+template <qint32 SHIFT>
+__attribute__((target("avx2")))
+static void rsum_roll_avx2(const unsigned char *data, qint32 blocksize, qint32 blockshift,
+                           rsum r, qint32 n, unsigned short *a, unsigned short *b) {
+    if (SHIFT) {
+        blocksize = 1 << SHIFT;
+        blockshift = SHIFT;
+    }
+    const __m128i shift = _mm_cvtsi32_si128(blockshift);
+    __m256i va = _mm256_set1_epi16((short)r.a),
+            vb = _mm256_set1_epi16((short)r.b);
+    qint32 k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m256i oc = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(data + k)));
+        __m256i nc = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(data + k + blocksize)));
+
+        __m256i na = _mm256_add_epi16(va, prefix_sum_epi16_avx2(_mm256_sub_epi16(nc, oc)));
+        __m256i nb = _mm256_add_epi16(vb,
+                                      prefix_sum_epi16_avx2(_mm256_sub_epi16(na, _mm256_sll_epi16(oc, shift))));
+
+        _mm256_storeu_si256((__m256i*)(a + k), na);
+        _mm256_storeu_si256((__m256i*)(b + k), nb);
+        va = broadcast_last_epi16_avx2(na);
+        vb = broadcast_last_epi16_avx2(nb);
+    }
+
+    if (k < n) {
+        if (k) {
+            r.a = a[k - 1];
+            r.b = b[k - 1];
+        }
+        rsum_roll_sse41<SHIFT>(data + k, blocksize, blockshift, r, n - k, a + k, b + k);
+    }
+}
+#endif // RSUM_ROLL_X86
+
+struct rsum_roll_dispatch {
+    rsum_roll_kernel kernel;
+    const char *name;
+};
+
+template <qint32 SHIFT>
+static rsum_roll_dispatch select_rsum_roll_kernel() {
+#ifdef RSUM_ROLL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return { rsum_roll_avx2<SHIFT>, "avx2" };
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return { rsum_roll_sse41<SHIFT>, "sse4.1" };
+    }
+#endif
+    return { rsum_roll_scalar<SHIFT>, "scalar" };
+}
+
+static const rsum_roll_dispatch &rsum_roll_selected() {
+    static const rsum_roll_dispatch selected = select_rsum_roll_kernel<0>();
+    return selected;
+}
+
+void rsum_roll(const unsigned char *data, qint32 blocksize, qint32 blockshift,
+               rsum r, qint32 n, unsigned short *a, unsigned short *b) {
+    rsum_roll_selected().kernel(data, blocksize, blockshift, r, n, a, b);
+}
+
+const char *rsum_roll_kernel_name() {
+    return rsum_roll_selected().name;
+}
+
+rsum_roll_kernel rsum_roll_kernel_for(qint32 blockshift) {
+    switch (blockshift) {
+    case 10:
+        return select_rsum_roll_kernel<10>().kernel;
+    case 11:
+        return select_rsum_roll_kernel<11>().kernel;
+    case 12:
+        return select_rsum_roll_kernel<12>().kernel;
+    default:
+        return rsum_roll_selected().kernel;
+    }
+}
@@ -32,9 +32,19 @@
  * @filename    : zsyncwriter_p.cc
  * @description : This is where the main zsync algorithm is implemented.
 */
+#include <algorithm>
 #include <cstdlib>
+#include <functional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QRegExp>
 
 #include "zsyncwriter_p.hpp"
+#include "zsyncrollingchecksum_p.hpp"
+#include "zsyncmd4_p.hpp"
 #include "qappimageupdateenums.hpp"
 #include "helpers_p.hpp"
 
@@ -45,14 +55,13 @@
  * Example:
  * 	LOGS "This is a log message." LOGE
  *
- *
+ * Every message has a buffer of its own, So the compute thread can log
+ * too. See log.
 */
 #ifndef LOGGING_DISABLED
-#define LOGS *(p_Logger.data()) <<
+#define LOGS do { QString s_LogLine; { QDebug s_LogStream(&s_LogLine); s_LogStream <<
 #define LOGR <<
-#define LOGE ; \
-	     emit(logger(s_LogBuffer , s_SourceFilePath)); \
-	     s_LogBuffer.clear();
+#define LOGE ; } log(s_LogLine); } while(0)
 #else
 #define LOGS (void)
 #define LOGR ;(void)
@@ -68,15 +77,6 @@
 #define FATAL_START LOGS "  FATAL: " LOGR
 #define FATAL_END LOGE
 
-/* Update a already calculated block ,
- * This is why a rolling checksum is needed. */
-#define UPDATE_RSUM(a, b, oldc, newc, bshift) do { \
-						(a) += ((unsigned char)(newc)) - ((unsigned char)(oldc));\
-       						(b) += (a) - ((oldc) << (bshift)); \
-					      } while (0)
-
-
-
 /*
  * Zsync uses the same modified version of the Adler32 checksum
  * as in rsync as the rolling checksum , here after denoted by rsum.
@@ -97,6 +97,21 @@ static rsum __attribute__ ((pure)) calc_rsum_block(const unsigned char *data, si
     }
 }
 
+/* Runs the given function in a thread pool. */
+class FunctionRunnable : public QRunnable {
+  public:
+    explicit FunctionRunnable(std::function<void()> function)
+        : m_Function(function) {
+        setAutoDelete(true);
+    }
+
+    void run() override {
+        m_Function();
+    }
+  private:
+    std::function<void()> m_Function;
+};
+
 /*
  * The main class which provides the qt zsync api.
  * This class is responsible to do the delta writing and only that,
@@ -109,23 +124,32 @@ static rsum __attribute__ ((pure)) calc_rsum_block(const unsigned char *data, si
 ZsyncWriterPrivate::ZsyncWriterPrivate(QNetworkAccessManager *manager)
     : QObject() {
     m_Manager = manager;
-    p_Md4Ctx.reset(new QCryptographicHash(QCryptographicHash::Md4));
-#ifndef LOGGING_DISABLED
-    p_Logger.reset(new QDebug(&s_LogBuffer));
-#endif // LOGGING_DISABLED	
+    p_ComputePool.reset(new QThreadPool);
+    p_ComputePool->setMaxThreadCount(1);
+    p_VerifyPool.reset(new QThreadPool);
+    n_ScanThreads = qMin(QThread::idealThreadCount(), PARALLEL_SCAN_MAX_THREADS);
+    p_VerifyPool->setMaxThreadCount(n_ScanThreads);
     return;
 }
 
 ZsyncWriterPrivate::~ZsyncWriterPrivate() {
+    /* Stop any running seed scan before we free what it is using. */
+    m_CancelToken.storeRelease(1);
+    p_ComputePool->waitForDone();
+    p_VerifyPool->waitForDone();
+
+    /* The temporary target file is removed with us, So is its journal. */
+    removeJournal();
+
     /* Free all c allocator allocated memory */
     if(p_RsumHash)
         free(p_RsumHash);
-    if(p_Ranges)
-        free(p_Ranges);
-    if(p_BlockHashes)
-        free(p_BlockHashes);
-    if(p_BitHash)
-        free(p_BitHash);
+    if(p_BlockRsums)
+        free(p_BlockRsums);
+    if(p_BlockCheckSums)
+        free(p_BlockCheckSums);
+    if(p_SeedFilter)
+        free(p_SeedFilter);
     return;
 }
 
@@ -137,6 +161,26 @@ void ZsyncWriterPrivate::setOutputDirectory(const QString &dir) {
     return;
 }
 
+/* Sets the extra seed files to scan along with the source file, Each entry
+ * is either a path or a wildcard pattern for the file name like
+ * /opt/apps/Krita-*.AppImage. */
+void ZsyncWriterPrivate::setSeedFiles(const QStringList &seeds) {
+    if(b_Started)
+        return;
+    m_SeedFiles = seeds;
+    return;
+}
+
+/* Sets the bounds of the no. of range requests in flight, The range
+ * downloader picks the no. within them from how the network does. */
+void ZsyncWriterPrivate::setConcurrentRequests(int minimum, int maximum) {
+    if(b_Started)
+        return;
+    n_MinConcurrentRequests = minimum;
+    n_MaxConcurrentRequests = maximum;
+    return;
+}
+
 /* Sets the logger name. */
 void ZsyncWriterPrivate::setLoggerName(const QString &name) {
     if(b_Started)
@@ -167,6 +211,17 @@ void ZsyncWriterPrivate::setShowLog(bool logNeeded) {
 }
 
 #ifndef LOGGING_DISABLED
+/* Emits the logger signal on the thread of this object, Messages from the
+ * compute thread are queued. */
+void ZsyncWriterPrivate::log(const QString &msg) {
+    if(QThread::currentThread() == thread()) {
+        emit logger(msg, s_SourceFilePath);
+        return;
+    }
+    QMetaObject::invokeMethod(this, "logger", Qt::QueuedConnection,
+                              Q_ARG(QString, msg), Q_ARG(QString, s_SourceFilePath));
+}
+
 void ZsyncWriterPrivate::handleLogMessage(QString msg, QString path) {
     qInfo().noquote()  << "["
                        <<  QDateTime::currentDateTime().toString(Qt::ISODate)
@@ -180,114 +235,115 @@ void ZsyncWriterPrivate::handleLogMessage(QString msg, QString path) {
 
 // Returns the required ranges
 bool ZsyncWriterPrivate::getBlockRanges() {
-    if(!p_Ranges || !n_Ranges || b_AcceptRange == false) {
+    if(m_KnownBlocks.isEmpty() || b_AcceptRange == false) {
         return false;
     }
 
     INFO_START " getBlockRanges : getting required block ranges." INFO_END;
 
-    int i, n;
-    int alloc_n = 100;
-    zs_blockid from = 0, to = n_Blocks;
-    zs_blockid *r = (zs_blockid*)malloc(2 * alloc_n * sizeof(zs_blockid));
-
-    if (!r)
-        return NULL;
-
-    r[0] = from;
-    r[1] = to;
-    n = 1;
-    /* Note r[2*n-1] is the last range in our prospective list */
-
-    for (i = 0; i < n_Ranges; i++) {
-        if (p_Ranges[2 * i] > r[2 * n - 1])
-            continue;
-        if (p_Ranges[2 * i + 1] < from)
-            continue;
-
-        /* Okay, they intersect */
-        if (n == 1 && p_Ranges[2 * i] <= from) {       /* Overlaps the start of our window */
-            r[0] = p_Ranges[2 * i + 1] + 1;
-        } else {
-            /* If the last block that we still (which is the last window end -1, due
-             * to half-openness) then this range just cuts the end of our window */
-            if (p_Ranges[2 * i + 1] >= r[2 * n - 1] - 1) {
-                r[2 * n - 1] = p_Ranges[2 * i];
-            } else {
-                /* In the middle of our range, split it */
-                r[2 * n] = p_Ranges[2 * i + 1] + 1;
-                r[2 * n + 1] = r[2 * n - 1];
-                r[2 * n - 1] = p_Ranges[2 * i];
-                n++;
-                if (n == alloc_n) {
-                    zs_blockid *r2;
-                    alloc_n += 100;
-                    r2 = (zs_blockid*)realloc(r, 2 * alloc_n * sizeof *r);
-                    if (!r2) {
-                        free(r);
-                        return NULL;
-                    }
-                    r = r2;
-                }
-            }
-        }
-    }
-    r = (zs_blockid*)realloc(r, 2 * n * sizeof *r);
-    if (n == 1 && r[0] >= r[1]) {
-        n = 0;
-    }
-
-    for(i = 0; i < n; ++i) {
+    /* The blocks we don't have are exactly the gaps between the known
+     * ranges, Request each gap as a half open block range. */
+    qint32 n = 0,
+           blocks = 0;
+    m_KnownBlocks.forEachGap(0, n_Blocks, [this, &n, &blocks](zs_blockid from, zs_blockid to) {
         // Note: to = to * blocksize - 1; As given by author.
-        auto to = r[2*i + 1];
-        auto from = r[2*i];
-
-
         INFO_START " getBlockRanges : (" LOGR from LOGR " , " LOGR to LOGR ")." INFO_END;
 
         m_RangeDownloader->appendRange(from, to);
-        QCoreApplication::processEvents();
-    }
+        ++n;
+        blocks += to - from;
+    });
 
     INFO_START " getBlockRanges : requesting " LOGR n LOGR " requests to server." INFO_END;
-
-    free((void*)r);
+    n_PendingBlocks = blocks;
+    m_RangeRequeues.clear();
+    n_NeededRanges = n;
+    n_RequestedRanges = n;
+    n_RedundantBytes = n_GapThreshold = 0;
     return true;
 }
 
+/* Keeps what the downloader traded when it merged ranges over blocks we
+ * already have, Reported when the target file is constructed. */
+void ZsyncWriterPrivate::handleRangesCoalesced(qint32 requestedRanges, qint64 redundantBytes, qint64 gapThreshold) {
+    n_RequestedRanges = requestedRanges;
+    n_RedundantBytes = redundantBytes;
+    n_GapThreshold = gapThreshold;
+    INFO_START " handleRangesCoalesced : " LOGR n_NeededRanges LOGR " ranges asked as " LOGR requestedRanges
+    LOGR " for " LOGR redundantBytes LOGR " redundant bytes, Gap threshold is " LOGR gapThreshold LOGR " bytes." INFO_END;
+}
+
 /* Simply writes whatever in downloadedData to the working target file ,
  * Used only if the downloader is downloading the entire file.
- * This automatically manages the memory of the given pointer to
- * QByteArray.
+ * The fragment comes from the range downloader's buffer pool and is given
+ * back to it here, The block writer shares the buffer until it is written
+ * so nothing is copied.
 */
 void ZsyncWriterPrivate::writeDataSequential(QByteArray *dataFragment, bool isLast) {
-    QScopedPointer<QByteArray> data(dataFragment);
     if(!p_TargetFile->isOpen()) {
         /*
          * If the target file is not opened then it most likely means
          * that the file is constructed successfully and so we have
          * no business in writting any further data.
         */
+        recycleDataFragment(dataFragment);
         return;
     }
 
     // Not to be confused with writeBlocks method
     // which updates n_BytesWritten by itself.
-    n_BytesWritten += p_TargetFile->write(*(data.data()));
+    const qint64 length = dataFragment->size();
+    p_BlockWriter->write(n_SequentialOffset, *dataFragment, 0, length);
+    recycleDataFragment(dataFragment);
+    n_SequentialOffset += length;
+    n_BytesWritten += length;
     if(isLast) {
-        QTimer::singleShot(2500, this, &ZsyncWriterPrivate::verifyAndConstructTargetFile);
+        finishWrites();
     }
     return;
 }
 
+/* Gives a fragment of writeDataSequential back to the buffer pool it
+ * came from, If the downloader is already gone it is simply freed. */
+void ZsyncWriterPrivate::recycleDataFragment(QByteArray *dataFragment) {
+    if(m_RangeDownloader.isNull()) {
+        delete dataFragment;
+        return;
+    }
+    m_RangeDownloader->recycle(dataFragment);
+}
+
+/*
+ * Completion barrier for the downloaded data.
+ * The downloader hands over the data through queued connections which
+ * are delivered in order, So when the last piece arrives every earlier
+ * piece is already queued on the block writer. Waits for the block
+ * writer to drain, emits writesCompleted and verifies the target file.
+*/
+void ZsyncWriterPrivate::finishWrites() {
+    if(!p_BlockWriter->flush()) {
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
+        FATAL_START " finishWrites : cannot write the temporary target file." FATAL_END;
+        emit error(QAppImageUpdateEnums::Error::CannotWriteTargetFile);
+        return;
+    }
+
+    INFO_START " finishWrites : all data written after " LOGR p_TransferSpeed->elapsed() LOGR " ms." INFO_END;
+    emit writesCompleted();
+    verifyAndConstructTargetFile();
+}
+
 /*
  * Writes the range in the correct block location.
  * Compares all blocks with the rolling checksum parsed
  * from the zsync control file.
  * Incase there is a mismatch , Only verified blocks are written the working target file.
+ * The rest of the range is then requested again, See RANGE_REQUEUE_LIMIT.
+ * The downloader may merge ranges across blocks we already have, Those
+ * blocks are neither checked nor written again.
 */
-void ZsyncWriterPrivate::writeBlockRanges(qint32 fromBlock, qint32 toBlock, QByteArray *downloadedData, bool isLast) {
-    unsigned char md4sum[CHECKSUM_SIZE];
+void ZsyncWriterPrivate::writeBlockRanges(qint32 fromBlock, qint32 toBlock, QByteArray *downloadedData) {
     /* Build checksum hash tables if we don't have them yet */
     if (!p_RsumHash) {
         if (!buildHash()) {
@@ -298,8 +354,8 @@ void ZsyncWriterPrivate::writeBlockRanges(qint32 fromBlock, qint32 toBlock, QByt
 
     bool Md4ChecksumsMatched = true;
     QScopedPointer<QByteArray> downloaded(downloadedData);
-    QScopedPointer<QBuffer> buffer(new QBuffer(downloadedData));
-    buffer->open(QIODevice::ReadOnly);
+    const qint32 neededBlocks = countUnknownBlocks(fromBlock, toBlock);
+    qint32 stillNeeded = 0;
 
 
 
@@ -329,41 +385,99 @@ void ZsyncWriterPrivate::writeBlockRanges(qint32 fromBlock, qint32 toBlock, QByt
     zs_blockid bfrom = fromBlock,
                bto = toBlock - 1;
 
-    for (zs_blockid x = bfrom; x <= bto; ++x) {
-        QByteArray blockData = buffer->read(n_BlockSize);
+    /*
+     * Hash all the blocks of the range at once with the multi buffer MD4,
+     * Blocks are hashed in place, Only a short last block is copied to be
+     * padded with zeros. Large ranges are cut into slices hashed by the
+     * verify pool, So fast links are not limited by a single core.
+    */
+    qint32 nblocks = qMax(bto - bfrom + 1, 0);
+    QByteArray shortBlock,
+               zeroBlock;
+    QVector<const unsigned char*> blocks(nblocks);
+    QVector<unsigned char> md4sums(nblocks * CHECKSUM_SIZE);
+    for (qint32 i = 0; i < nblocks; ++i) {
+        qint64 offset = (qint64)i * n_BlockSize;
+        if(offset + n_BlockSize <= downloaded->size()) {
+            blocks[i] = (const unsigned char*)downloaded->constData() + offset;
+            continue;
+        }
+
         //// Fill with zeros if the block size is less than the required blocksize.
-        if(blockData.size() != n_BlockSize) {
-            INFO_START " writeBlockRanges : padding block(" LOGR bfrom LOGR "," LOGR bto LOGR ")." INFO_END;
-            QByteArray newBlockData;
-            newBlockData.fill('\0', (n_BlockSize - blockData.size()));
-            blockData.append(newBlockData);
-        }
-        calcMd4Checksum(&md4sum[0], (const unsigned char*)blockData.constData(), n_BlockSize);
-        if(memcmp(&md4sum, &(p_BlockHashes[x].checksum[0]), n_StrongCheckSumBytes)) {
+        INFO_START " writeBlockRanges : padding block(" LOGR bfrom LOGR "," LOGR bto LOGR ")." INFO_END;
+        if(offset < downloaded->size()) {
+            shortBlock.fill('\0', n_BlockSize);
+            memcpy(shortBlock.data(), downloaded->constData() + offset, downloaded->size() - offset);
+            blocks[i] = (const unsigned char*)shortBlock.constData();
+        } else {
+            if(zeroBlock.isEmpty()) {
+                zeroBlock.fill('\0', n_BlockSize);
+            }
+            blocks[i] = (const unsigned char*)zeroBlock.constData();
+        }
+    }
+    const qint64 sliceBlocks = qMax<qint64>(1, VERIFY_SLICE_MIN_SIZE / n_BlockSize);
+    const int slices = (int)qMin<qint64>(p_VerifyPool->maxThreadCount(), nblocks / sliceBlocks);
+    if (slices > 1) {
+        const qint32 perSlice = (nblocks + slices - 1) / slices;
+        for (qint32 from = 0; from < nblocks; from += perSlice) {
+            const qint32 count = qMin(perSlice, nblocks - from);
+            const unsigned char *const *sliceData = blocks.constData() + from;
+            unsigned char *sliceSums = md4sums.data() + (qint64)from * CHECKSUM_SIZE;
+            const qint32 blockSize = n_BlockSize;
+            p_VerifyPool->start(new FunctionRunnable([sliceData, blockSize, count, sliceSums]() {
+                md4_digest_many(sliceData, blockSize, count, sliceSums);
+            }));
+        }
+        p_VerifyPool->waitForDone();
+    } else {
+        md4_digest_many(blocks.constData(), n_BlockSize, nblocks, md4sums.data());
+    }
+
+    for (zs_blockid x = bfrom; x <= bto; ++x) {
+        const unsigned char *md4sum = md4sums.constData() + (x - bfrom) * CHECKSUM_SIZE;
+        if(!alreadyGotBlock(x) && memcmp(md4sum, blockCheckSum(x), n_StrongCheckSumBytes)) {
             Md4ChecksumsMatched = false;
             WARNING_START " writeBlockRanges : block(" LOGR bfrom LOGR "," LOGR bto LOGR ")." WARNING_END;
             WARNING_START " writeBlockRanges : MD4 checksums mismatch." WARNING_END;
             WARNING_START " writeBlockRanges : MD4 Sum of Data : " LOGR
-            QByteArray((const char *)(&md4sum[0])).toHex() WARNING_END;
+            QByteArray((const char *)md4sum, CHECKSUM_SIZE).toHex() WARNING_END;
             WARNING_START " writeBlockRanges : MD4 Sum of Required :  " LOGR
-            QByteArray((const char *)(&(p_BlockHashes[x].checksum[0]))).toHex() WARNING_END;
+            QByteArray((const char *)blockCheckSum(x), n_StrongCheckSumBytes).toHex() WARNING_END;
             if (x > bfrom) {    /* Write any good blocks we did get */
                 INFO_START " writeBlockRanges : only writting good blocks. " INFO_END;
-                writeBlocks((const unsigned char*)downloaded->constData(), bfrom, x - 1);
+                writeDownloadedBlocks(*downloaded, bfrom, x - 1);
+            }
+
+            /* And ask for the rest of the range again, A corrupted response
+             * should only cost us this range. */
+            qint32 &requeues = m_RangeRequeues[x];
+            if (requeues < RANGE_REQUEUE_LIMIT) {
+                ++requeues;
+                stillNeeded = countUnknownBlocks(x, toBlock);
+                WARNING_START " writeBlockRanges : requesting (" LOGR x LOGR "," LOGR toBlock LOGR ") again." WARNING_END;
+                m_RangeDownloader->requeueRange(x, toBlock);
+            } else {
+                WARNING_START " writeBlockRanges : no retries left for block(" LOGR x LOGR "," LOGR bto LOGR ")." WARNING_END;
             }
             break;
         }
-        QCoreApplication::processEvents();
     }
 
 
     if(Md4ChecksumsMatched) {
-        writeBlocks((const unsigned char*)downloaded->constData(), bfrom, bto);
+        writeDownloadedBlocks(*downloaded, bfrom, bto);
     }
 
 
-    if(isLast) {
-        QTimer::singleShot(2500, this, &ZsyncWriterPrivate::verifyAndConstructTargetFile);
+    /* The downloader only knows about its own queue, So a range requested
+     * again is counted here. Blocks are counted since the downloader may
+     * have merged ranges. */
+    n_PendingBlocks -= neededBlocks - stillNeeded;
+    if(n_PendingBlocks <= 0) {
+        finishWrites();
+    } else if(m_JournalTimer.elapsed() >= JOURNAL_SAVE_INTERVAL) {
+        saveJournal();
     }
 
     return;
@@ -388,7 +502,7 @@ void ZsyncWriterPrivate::setConfiguration(qint32 blocksize,
         qint32 weakChecksumBytes,
         qint32 strongChecksumBytes,
         qint32 seqMatches,
-        qint32 targetFileLength,
+        qint64 targetFileLength,
         const QString &sourceFilePath,
         const QString &targetFileName,
         const QString &targetFileSHA1,
@@ -396,6 +510,17 @@ void ZsyncWriterPrivate::setConfiguration(qint32 blocksize,
         QBuffer *targetFileCheckSumBlocks,
         bool rangeSupported,
         QUrl torrentFileUrl) {
+    if(b_Scanning) {
+        /* The compute thread still reads the tables freed below, Stop it
+         * and end the old run here. Its queued result is ignored. */
+        WARNING_START " setConfiguration : waiting for the compute thread to stop." WARNING_END;
+        m_CancelToken.storeRelease(1);
+        p_ComputePool->waitForDone();
+        ++n_ComputeId;
+        b_Scanning = false;
+        b_Started = false;
+        emit canceled();
+    }
     p_CurrentWeakCheckSums = qMakePair(rsum({ 0, 0 }), rsum({ 0, 0 }));
     n_Blocks = nblocks,
     n_BlockSize = blocksize,
@@ -408,8 +533,8 @@ void ZsyncWriterPrivate::setConfiguration(qint32 blocksize,
     n_SeqMatches = seqMatches;
     n_TargetFileLength = targetFileLength;
     p_TargetFileCheckSumBlocks.reset(targetFileCheckSumBlocks);
-    n_Skip = n_NextKnown =p_HashMask = p_BitHashMask = 0;
-    p_Rover = p_NextMatch = nullptr;
+    n_Skip = n_NextKnown =p_HashMask = n_SeedFilterMask = n_HashShift = 0;
+    n_NextMatch = -1;
     b_AcceptRange = rangeSupported;
     b_TorrentAvail = torrentFileUrl.isValid();
     u_TorrentFileUrl = torrentFileUrl;
@@ -422,21 +547,22 @@ void ZsyncWriterPrivate::setConfiguration(qint32 blocksize,
     // the control file parser side and the control file parser initiats the zsync writer(this class)
     // after it has parsed the control file.
     // Without the below line, the zsync writer will not recover from a error or cancel.
-    b_Started = b_CancelRequested = false;
+    b_Started = false;
+    m_CancelToken.storeRelease(0);
 
     u_TargetFileUrl = targetFileUrl;
-    if(p_BlockHashes) {
-        free(p_BlockHashes);
-        p_BlockHashes = nullptr;
+    if(p_BlockRsums) {
+        free(p_BlockRsums);
+        p_BlockRsums = nullptr;
     }
-    p_BlockHashes = (hash_entry*)calloc(n_Blocks + n_SeqMatches, sizeof(p_BlockHashes[0]));
-
-    if(p_Ranges) {
-        free(p_Ranges);
-        p_Ranges = nullptr;
-        n_Ranges = 0;
+    if(p_BlockCheckSums) {
+        free(p_BlockCheckSums);
+        p_BlockCheckSums = nullptr;
     }
-    p_Md4Ctx->reset();
+    p_BlockRsums = (rsum*)calloc(n_Blocks + n_SeqMatches, sizeof(p_BlockRsums[0]));
+    p_BlockCheckSums = (unsigned char*)calloc(n_Blocks + n_SeqMatches, n_StrongCheckSumBytes);
+
+    m_KnownBlocks.clear();
 
     s_SourceFilePath = sourceFilePath;
     s_TargetFileName = targetFileName;
@@ -460,11 +586,20 @@ void ZsyncWriterPrivate::setConfiguration(qint32 blocksize,
         return;
     }
 
+    removeJournal();
+    p_BlockWriter.reset();
     p_TargetFile.reset(new QTemporaryFile(targetFilePath));
     if(!p_TargetFile->open()) {
         emit error(QAppImageUpdateEnums::Error::CannotOpenTargetFile);
         return;
     }
+    n_SequentialOffset = 0;
+    p_BlockWriter.reset(new ZsyncBlockWriter(p_TargetFile->handle(), n_TargetFileLength));
+    if(!p_BlockWriter->preallocate(n_TargetFileLength)) {
+        WARNING_START " setConfiguration : cannot preallocate the temporary file." WARNING_END;
+    }
+    p_BlockWriter->start();
+    m_JournalTimer.start();
     /*
      * To open the target file we have to
      * request fileName() from the temporary file.
@@ -498,12 +633,18 @@ void ZsyncWriterPrivate::setConfiguration(qint32 blocksize,
 
 /* cancels the started process. */
 void ZsyncWriterPrivate::cancel() {
+    if(b_Scanning) {
+        /* The compute thread will see the token and the cancel is reported
+         * when it stops. */
+        m_CancelToken.storeRelease(1);
+        return;
+    }
     INFO_START " cancel : cancel requested." INFO_END;
     if(!b_Started) {
         INFO_START " cancel : called before started!" INFO_END;
         return;
     }
-    b_CancelRequested = true;
+    m_CancelToken.storeRelease(1);
 #if defined(DECENTRALIZED_UPDATE_ENABLED) && LIBTORRENT_VERSION_NUM >= 10208
     if(b_TorrentAvail && b_AcceptRange) {
         if(!m_TorrentDownloader.isNull()) {
@@ -520,10 +661,15 @@ void ZsyncWriterPrivate::cancel() {
         m_RangeDownloader->cancel();
     }
 #endif // DECENTRALIZED_UPDATE_ENABLED
-    INFO_START " cancel : cancel requested " LOGR b_CancelRequested LOGR "." INFO_END;
+    INFO_START " cancel : cancel requested " LOGR isCancelRequested() LOGR "." INFO_END;
     return;
 }
 
+/* Returns true if a cancel was requested, Safe to call from any thread. */
+bool ZsyncWriterPrivate::isCancelRequested() const {
+    return m_CancelToken.loadAcquire() != 0;
+}
+
 /// You should only start after getting finishedConfiguring signal.
 //  If not, start does not work.
 /* start the zsync algorithm. */
@@ -531,12 +677,11 @@ void ZsyncWriterPrivate::start() {
     if(b_Started || !b_Configured)
         return;
     b_Configured = false;
-    b_CancelRequested = false;
+    m_CancelToken.storeRelease(0);
     b_Started = true;
     emit started();
 
     INFO_START " start : starting delta writer." INFO_END;
-    short errorCode = 0;
 
     /*
      * Check if we have some incomplete downloads.
@@ -559,173 +704,252 @@ void ZsyncWriterPrivate::start() {
                 ++iter
            ) {
             foundGarbageFiles << (*iter).absoluteFilePath();
-            QCoreApplication::processEvents();
         }
         foundGarbageFiles.removeAll(QFileInfo(p_TargetFile->fileName()).absoluteFilePath());
         foundGarbageFiles.removeDuplicates();
     }
+    QStringList extraSeedFiles = findSeedFiles(foundGarbageFiles);
+
+    /*
+     * The seed scan can take a long time, So it is run on the compute
+     * thread and this thread goes back to its event loop, Which keeps
+     * cancel responsive without pumping events from the scan loops.
+     * handleSeedScanFinished continues from here when the scan is over.
+    */
+    b_Scanning = true;
+    const qint32 id = n_ComputeId;
+    p_ComputePool->start(new FunctionRunnable([this, foundGarbageFiles, extraSeedFiles, id]() {
+        short errorCode = 0;
+        qint32 result = scanSeedFiles(foundGarbageFiles, extraSeedFiles, &errorCode);
+        QMetaObject::invokeMethod(this, "handleSeedScanFinished",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(qint32, result),
+                                  Q_ARG(short, errorCode),
+                                  Q_ARG(qint32, id));
+    }));
+    return;
+}
+
+/*
+ * Expands the seed files given with setSeedFiles to the existing files
+ * which are not already a seed, Newest first. Patterns are matched against
+ * the file names in the directory of the pattern.
+*/
+QStringList ZsyncWriterPrivate::findSeedFiles(const QStringList &foundGarbageFiles) const {
+    QStringList known;
+    known << QFileInfo(s_SourceFilePath).absoluteFilePath()
+          << QFileInfo(p_TargetFile->fileName()).absoluteFilePath()
+          << QFileInfo(QFileInfo(p_TargetFile->fileName()).path() + "/" + s_TargetFileName).absoluteFilePath()
+          << foundGarbageFiles;
+
+    QStringList seeds;
+    for(auto iter = m_SeedFiles.constBegin(),
+            end = m_SeedFiles.constEnd();
+            iter != end;
+            ++iter) {
+        QFileInfo entry(*iter);
+        QFileInfoList found;
+        if(entry.fileName().contains(QRegExp("[*?\\[]"))) {
+            found = entry.dir().entryInfoList(QStringList() << entry.fileName(),
+                                              QDir::Files | QDir::Readable,
+                                              QDir::Time);
+        } else if(entry.isFile()) {
+            found << entry;
+        }
+
+        for(const QFileInfo &info : found) {
+            QString path = info.absoluteFilePath();
+            if(!known.contains(path) && !seeds.contains(path)) {
+                seeds << path;
+            }
+        }
+    }
+
+    if(!seeds.isEmpty()) {
+        INFO_START " findSeedFiles : found " LOGR seeds.size() LOGR " extra seed files." INFO_END;
+    }
+    return seeds;
+}
 
+/*
+ * Runs on the compute thread, Checks if the target file was already
+ * downloaded and if not then scans all the seed files we have for blocks
+ * of the target file.
+ * Returns one of the SeedScanResult values, errorCode is set on
+ * SeedScanError.
+*/
+qint32 ZsyncWriterPrivate::scanSeedFiles(const QStringList &foundGarbageFiles, const QStringList &extraSeedFiles, short *errorCode) {
     /*
-     * Check if we have the target file already downloaded if 
+     * Check if we have the target file already downloaded if
      * so just emit finish and don't run the delta updater.
      */
-     {
-            QString alreadyDownloadedTargetFile = QFileInfo(p_TargetFile->fileName()).path() + "/" + s_TargetFileName;
-            QFileInfo info(alreadyDownloadedTargetFile);
-            QFile file(alreadyDownloadedTargetFile);
-	    if(info.exists() && info.isReadable() && file.open(QIODevice::ReadOnly)) {
-             INFO_START " start : found file with same remote target file name. Running SHA1 verification." INFO_END;
-
-    	     QScopedPointer<QCryptographicHash> SHA1Hasher(new QCryptographicHash(QCryptographicHash::Sha1));
-	     qint64 bufferSize = 1024;
-	     
-	     if(n_TargetFileLength >= 1073741824) { // 1 GiB and more.
-        	bufferSize = 104857600; // copy per 100 MiB.
-    	     } else if(n_TargetFileLength >= 1048576 ) { // 1 MiB and more
-		     bufferSize = 1048576; // copy per 1 MiB.
-    	     } else if(n_TargetFileLength  >= 1024) { // 1 KiB and more.
-		     bufferSize = 4096; // copy per 4 KiB.
-	     } else { // less than 1 KiB
-		     bufferSize = 1024; // copy per 1 KiB.
-	     }
-	     
-	     while(!file.atEnd()) {
-        	SHA1Hasher->addData(file.read(bufferSize));
-        	QCoreApplication::processEvents();
-    	     }
-	     file.close();
-
-    	     auto sha1Hash = QString(SHA1Hasher->result().toHex().toUpper()); 
-	     INFO_START " start : comparing temporary target file sha1 hash(" LOGR sha1Hash
-		     LOGR ") and remote target file sha1 hash(" LOGR s_TargetFileSHA1 INFO_END;
-	     
-	     if(sha1Hash == s_TargetFileSHA1) {
-	         INFO_START " start : SHA1 hash matches." INFO_END;
-		 /*
-		  * * Emit finished signal. */   
-		  QJsonObject newVersionDetails {
-		  {"AbsolutePath", alreadyDownloadedTargetFile },
-                  {"Sha1Hash", sha1Hash},
-                  {"UsedTorrent", false},
-	          {"TorrentFileUrl", u_TorrentFileUrl.isValid() ? u_TorrentFileUrl.toString() : ""}
-                  };
-
-                  b_Started = b_CancelRequested = false;
-                  emit finished(newVersionDetails, s_SourceFilePath);
-		  return;
-	     }else {
-		  INFO_START " start : sha1 hash mismatch." INFO_END;
-	     }
-	    }
-    }
-
-    if(b_AcceptRange == true) {
-        /*
-         * Check if we have the target file already downloaded
-         * in the output of the target file directory.
-        */
-        {
-            QString alreadyDownloadedTargetFile = QFileInfo(p_TargetFile->fileName()).path() + "/" + s_TargetFileName;
-            QFileInfo info(alreadyDownloadedTargetFile);
-            if(info.exists() && info.isReadable()) {
-                QFile *targetFile = nullptr;
-                if((errorCode = tryOpenSourceFile(alreadyDownloadedTargetFile, &targetFile)) > 0) {
-                    emit error(errorCode);
-                    return;
-                }
+    {
+        QString alreadyDownloadedTargetFile = QFileInfo(p_TargetFile->fileName()).path() + "/" + s_TargetFileName;
+        QFileInfo info(alreadyDownloadedTargetFile);
+        QFile file(alreadyDownloadedTargetFile);
+        if(info.exists() && info.isReadable() && file.open(QIODevice::ReadOnly)) {
+            INFO_START " start : found file with same remote target file name. Running SHA1 verification." INFO_END;
+
+            QScopedPointer<QCryptographicHash> SHA1Hasher(new QCryptographicHash(QCryptographicHash::Sha1));
+            qint64 bufferSize = 1024;
+
+            if(n_TargetFileLength >= 1073741824) { // 1 GiB and more.
+                bufferSize = 104857600; // copy per 100 MiB.
+            } else if(n_TargetFileLength >= 1048576 ) { // 1 MiB and more
+                bufferSize = 1048576; // copy per 1 MiB.
+            } else if(n_TargetFileLength  >= 1024) { // 1 KiB and more.
+                bufferSize = 4096; // copy per 4 KiB.
+            } else { // less than 1 KiB
+                bufferSize = 1024; // copy per 1 KiB.
+            }
 
+            while(!file.atEnd()) {
+                SHA1Hasher->addData(file.read(bufferSize));
+                if(isCancelRequested()) {
+                    return SeedScanCanceled;
+                }
+            }
+            file.close();
 
-                int r = 0;
-                if((r = submitSourceFile(targetFile)) < 0) {
-                    if(r == -2) {
-                        /// Cannot construst hash table.
-                        b_Started = b_CancelRequested = false;
-                        emit error(QAppImageUpdateEnums::Error::HashTableNotAllocated);
-                    } else if(r == -3) {
-                        /// Canceled the update
-                        b_Started = false;
-                    }
+            auto sha1Hash = QString(SHA1Hasher->result().toHex().toUpper());
+            INFO_START " start : comparing temporary target file sha1 hash(" LOGR sha1Hash
+            LOGR ") and remote target file sha1 hash(" LOGR s_TargetFileSHA1 INFO_END;
 
-                    if(r != -1) {
-                        /// -1 cannot allocate memory.
-                        return;
-                    }
-                }
-                delete targetFile;
+            if(sha1Hash == s_TargetFileSHA1) {
+                INFO_START " start : SHA1 hash matches." INFO_END;
+                return SeedScanTargetExists;
+            } else {
+                INFO_START " start : sha1 hash mismatch." INFO_END;
             }
         }
+    }
 
-        if(n_BytesWritten < n_TargetFileLength) {
-            for(auto iter = foundGarbageFiles.constBegin(),
-                    end  = foundGarbageFiles.constEnd();
-                    iter != end && n_BytesWritten < n_TargetFileLength;
-                    ++iter) {
-                QFile *sourceFile = nullptr;
-                if((errorCode = tryOpenSourceFile(*iter, &sourceFile)) > 0) {
-                    emit error(errorCode);
-                    return;
-                }
+    if(b_AcceptRange == false) {
+        return SeedScanDone;
+    }
 
-                int r = 0;
-                if((r = submitSourceFile(sourceFile)) < 0) {
-                    if(r == -2) {
-                        /// Cannot construst hash table.
-                        b_Started = b_CancelRequested = false;
-                        emit error(QAppImageUpdateEnums::Error::HashTableNotAllocated);
-                    } else if(r == -3) {
-                        /// Canceled the update
-                        b_Started = false;
-                    }
-                    if(r != -1) {
-                        /// -1 cannot allocate memory.
-                        return;
-                    }
-                }
-                delete sourceFile;
-                QFile::remove((*iter));
-            }
+    /*
+     * Scan the file with the target file name, The incomplete downloads and
+     * then the given seed file, Until we have the entire target file.
+     * Failing to allocate memory is only fatal for the given seed file.
+    */
+    QStringList seedFiles;
+    {
+        QString alreadyDownloadedTargetFile = QFileInfo(p_TargetFile->fileName()).path() + "/" + s_TargetFileName;
+        QFileInfo info(alreadyDownloadedTargetFile);
+        if(info.exists() && info.isReadable()) {
+            seedFiles << alreadyDownloadedTargetFile;
+        }
+    }
+    /*
+     * Incomplete downloads of the same target with a journal are adopted
+     * without scanning them, The others are removed once scanned.
+    */
+    for(const QString &garbageFile : foundGarbageFiles) {
+        qint32 r = adoptJournaledFile(garbageFile);
+        if(r == -2) {
+            *errorCode = QAppImageUpdateEnums::Error::HashTableNotAllocated;
+            return SeedScanError;
+        } else if(r == -3) {
+            return SeedScanCanceled;
+        } else if(r == 0) {
+            seedFiles << garbageFile;
+        } else {
+            QFile::remove(ZsyncJournal::pathOf(garbageFile));
+            QFile::remove(garbageFile);
         }
+    }
+    seedFiles << s_SourceFilePath;
 
+    for(int i = 0; i < seedFiles.size() && n_BytesWritten < n_TargetFileLength; ++i) {
+        const QString &seedFile = seedFiles.at(i);
+        const bool isSourceFile = (i == seedFiles.size() - 1);
 
-        if(n_BytesWritten < n_TargetFileLength) {
-            QFile *sourceFile = nullptr;
-            if((errorCode = tryOpenSourceFile(s_SourceFilePath, &sourceFile)) > 0) {
-                emit error(errorCode);
-                return;
+        QFile *sourceFile = nullptr;
+        if((*errorCode = tryOpenSourceFile(seedFile, &sourceFile)) > 0) {
+            return SeedScanError;
+        }
+        QScopedPointer<QFile> source(sourceFile);
+
+        /* The extra seeds are scanned together with the source file. */
+        int r = (isSourceFile && !extraSeedFiles.isEmpty()) ?
+                submitSourceFiles(source.data(), extraSeedFiles) :
+                submitSourceFile(source.data());
+        if(r < 0) {
+            if(r == -1 && isSourceFile) {
+                /// Cannot allocate buffer memory
+                *errorCode = QAppImageUpdateEnums::Error::NotEnoughMemory;
+                return SeedScanError;
+            } else if(r == -2) {
+                /// Cannot construst hash table.
+                *errorCode = QAppImageUpdateEnums::Error::HashTableNotAllocated;
+                return SeedScanError;
+            } else if(r == -3) {
+                /// Canceled the update
+                return SeedScanCanceled;
             }
+        }
 
-            int r = 0;
-            if((r = submitSourceFile(sourceFile)) < 0) {
-                delete sourceFile;
-                if(r == -1) {
-                    /// Cannot allocate buffer memory
-                    b_Started = b_CancelRequested = false;
-                    emit error(QAppImageUpdateEnums::Error::NotEnoughMemory);
-                } else if(r == -2) {
-                    /// Cannot construst hash table.
-                    b_Started = b_CancelRequested = false;
-                    emit error(QAppImageUpdateEnums::Error::HashTableNotAllocated);
-                } else if(r == -3) {
-                    /// Canceled the update
-                    b_Started = false;
-                }
-                b_Started = b_CancelRequested = false;
-                return;
-            }
-            delete sourceFile;
+        if(foundGarbageFiles.contains(seedFile)) {
+            source.reset();
+            QFile::remove(ZsyncJournal::pathOf(seedFile));
+            QFile::remove(seedFile);
         }
     }
+    return SeedScanDone;
+}
+
+/*
+ * Continues start after the compute thread finished the seed scan, Either
+ * finishes right away or starts downloading what is left.
+*/
+void ZsyncWriterPrivate::handleSeedScanFinished(qint32 result, short errorCode, qint32 id) {
+    if(id != n_ComputeId) {
+        return;
+    }
+    b_Scanning = false;
+
+    if(result == SeedScanTargetExists) {
+        QString alreadyDownloadedTargetFile = QFileInfo(p_TargetFile->fileName()).path() + "/" + s_TargetFileName;
+        /*
+         * * Emit finished signal. */
+        QJsonObject newVersionDetails {
+            {"AbsolutePath", alreadyDownloadedTargetFile },
+            {"Sha1Hash", s_TargetFileSHA1},
+            {"UsedTorrent", false},
+            {"TorrentFileUrl", u_TorrentFileUrl.isValid() ? u_TorrentFileUrl.toString() : ""}
+        };
+
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
+        emit finished(newVersionDetails, s_SourceFilePath);
+        return;
+    }
+
+    if(result == SeedScanCanceled || isCancelRequested()) {
+        INFO_START " handleSeedScanFinished : canceled." INFO_END;
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
+        emit canceled();
+        return;
+    }
+
+    if(result == SeedScanError) {
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
+        emit error(errorCode);
+        return;
+    }
+
+    /* Record what the seed scan found, So it survives an interrupted download. */
+    if(n_BytesWritten < n_TargetFileLength && !m_KnownBlocks.isEmpty()) {
+        saveJournal();
+    }
 
     p_TransferSpeed.reset(new QElapsedTimer); // Refresh timer.
     p_TransferSpeed->start();
 
     if(n_BytesWritten >= n_TargetFileLength) {
-        QCoreApplication::processEvents(); // Check if cancel requested.
-        if(b_CancelRequested) {
-            b_Started = b_CancelRequested = false;
-            emit canceled();
-            return;
-        }
         verifyAndConstructTargetFile();
     }
 #if defined(DECENTRALIZED_UPDATE_ENABLED) && LIBTORRENT_VERSION_NUM >= 10208
@@ -736,6 +960,8 @@ void ZsyncWriterPrivate::start() {
     /// the update will just be quietly waiting for seeds forever.
     /// So the best way is to just do a dumb http download.
     else if(b_TorrentAvail && b_AcceptRange) {
+        /* The torrent client writes to the target file by itself. */
+        p_BlockWriter->flush();
         m_TorrentDownloader->setTargetFileDone(n_BytesWritten);
         m_TorrentDownloader->setTargetFileLength(n_TargetFileLength);
         m_TorrentDownloader->setTorrentFileUrl(u_TorrentFileUrl);
@@ -768,7 +994,7 @@ void ZsyncWriterPrivate::start() {
         m_RangeDownloader->setTargetFileLength(n_TargetFileLength);
         m_RangeDownloader->setBytesWritten(n_BytesWritten);
 
-        if(!p_Ranges || !n_Ranges || b_AcceptRange == false) {
+        if(m_KnownBlocks.isEmpty() || b_AcceptRange == false) {
             m_RangeDownloader->setFullDownload(true);
             // Full Download
             connect(m_RangeDownloader.data(), &RangeDownloader::data,
@@ -781,6 +1007,8 @@ void ZsyncWriterPrivate::start() {
             if(partial) {
                 connect(m_RangeDownloader.data(), &RangeDownloader::rangeData,
                         this, &ZsyncWriterPrivate::writeBlockRanges, Qt::QueuedConnection);
+                connect(m_RangeDownloader.data(), &RangeDownloader::rangesCoalesced,
+                        this, &ZsyncWriterPrivate::handleRangesCoalesced, Qt::QueuedConnection);
 
             } else {
                 connect(m_RangeDownloader.data(), &RangeDownloader::data,
@@ -795,9 +1023,15 @@ void ZsyncWriterPrivate::start() {
         connect(m_RangeDownloader.data(), &RangeDownloader::progress,
                 this, &ZsyncWriterPrivate::progress, Qt::DirectConnection);
 
+        connect(m_RangeDownloader.data(), &RangeDownloader::concurrentRequests,
+                this, &ZsyncWriterPrivate::concurrentRequests, Qt::DirectConnection);
+
         connect(m_RangeDownloader.data(), &RangeDownloader::error,
                 this, &ZsyncWriterPrivate::handleNetworkError, Qt::QueuedConnection);
 
+        if(n_MinConcurrentRequests > 0) {
+            m_RangeDownloader->setConcurrentRequests(n_MinConcurrentRequests, n_MaxConcurrentRequests);
+        }
         m_RangeDownloader->setBlockSize(n_BlockSize);
         m_RangeDownloader->setTargetFileUrl(u_TargetFileUrl);
         m_RangeDownloader->start();
@@ -827,7 +1061,7 @@ void ZsyncWriterPrivate::handleTorrentError(QNetworkReply::NetworkError code) {
     m_RangeDownloader->setTargetFileLength(n_TargetFileLength);
     m_RangeDownloader->setBytesWritten(n_BytesWritten);
 
-    if(!p_Ranges || !n_Ranges || b_AcceptRange == false) {
+    if(m_KnownBlocks.isEmpty() || b_AcceptRange == false) {
         m_RangeDownloader->setFullDownload(true);
         // Full Download
         connect(m_RangeDownloader.data(), &RangeDownloader::data,
@@ -840,6 +1074,8 @@ void ZsyncWriterPrivate::handleTorrentError(QNetworkReply::NetworkError code) {
         if(partial) {
             connect(m_RangeDownloader.data(), &RangeDownloader::rangeData,
                     this, &ZsyncWriterPrivate::writeBlockRanges, Qt::QueuedConnection);
+            connect(m_RangeDownloader.data(), &RangeDownloader::rangesCoalesced,
+                    this, &ZsyncWriterPrivate::handleRangesCoalesced, Qt::QueuedConnection);
 
         } else {
             connect(m_RangeDownloader.data(), &RangeDownloader::data,
@@ -853,9 +1089,15 @@ void ZsyncWriterPrivate::handleTorrentError(QNetworkReply::NetworkError code) {
     connect(m_RangeDownloader.data(), &RangeDownloader::progress,
             this, &ZsyncWriterPrivate::progress, Qt::DirectConnection);
 
+    connect(m_RangeDownloader.data(), &RangeDownloader::concurrentRequests,
+            this, &ZsyncWriterPrivate::concurrentRequests, Qt::DirectConnection);
+
     connect(m_RangeDownloader.data(), &RangeDownloader::error,
             this, &ZsyncWriterPrivate::handleNetworkError, Qt::QueuedConnection);
 
+    if(n_MinConcurrentRequests > 0) {
+        m_RangeDownloader->setConcurrentRequests(n_MinConcurrentRequests, n_MaxConcurrentRequests);
+    }
     m_RangeDownloader->setBlockSize(n_BlockSize);
     m_RangeDownloader->setTargetFileUrl(u_TargetFileUrl);
     m_RangeDownloader->start();
@@ -867,12 +1109,34 @@ void ZsyncWriterPrivate::handleTorrentLogger(QString msg) {
 #endif // DECENTRALIZED_UPDATE_ENABLED
 
 void ZsyncWriterPrivate::handleCancel() {
-    b_CancelRequested = false;
+    m_CancelToken.storeRelease(0);
     b_Started = false;
     INFO_START " handleCancel : canceled." INFO_END;
     emit canceled();
 }
 
+/* Decodes the weak and strong checksums of the given no. of blocks from
+ * the control file records at data, Each record is the last WeakBytes of
+ * the big endian rsum followed by n_StrongCheckSumBytes of MD4. */
+template <qint32 WeakBytes>
+void ZsyncWriterPrivate::decodeCheckSumBlocks(const unsigned char *data, zs_blockid blocks) {
+    const qint32 strong = n_StrongCheckSumBytes;
+    const unsigned short mask = p_WeakCheckSumMask;
+    unsigned char *checksums = p_BlockCheckSums;
+    rsum *rsums = p_BlockRsums;
+    for (zs_blockid id = 0; id < blocks; ++id) {
+        quint32 r = 0;
+        for (qint32 k = 0; k < WeakBytes; ++k) {
+            r = (r << 8) | data[k];
+        }
+        rsums[id].a = (unsigned short)(r >> 16) & mask;
+        rsums[id].b = (unsigned short)r;
+        memcpy(checksums, data + WeakBytes, strong);
+        checksums += strong;
+        data += WeakBytes + strong;
+    }
+}
+
 /*
  * This private method parses the raw checksum blocks from the zsync control file
  * and then constructs the hash table , If some error is detected , this returns
@@ -888,60 +1152,54 @@ void ZsyncWriterPrivate::handleCancel() {
  * 		// Handle error.
 */
 short ZsyncWriterPrivate::parseTargetFileCheckSumBlocks() {
-    if(!p_BlockHashes) {
+    if(!p_BlockRsums || !p_BlockCheckSums) {
         return QAppImageUpdateEnums::Error::HashTableNotAllocated;
-    } else if(!p_TargetFileCheckSumBlocks ||
-              p_TargetFileCheckSumBlocks->size() < (n_WeakCheckSumBytes + n_StrongCheckSumBytes)) {
+    } else if(!p_TargetFileCheckSumBlocks) {
         return QAppImageUpdateEnums::Error::InvalidTargetFileChecksumBlocks;
-    } else {
+    } else if(!p_TargetFileCheckSumBlocks->isOpen()) {
         if(!p_TargetFileCheckSumBlocks->open(QIODevice::ReadOnly))
             return QAppImageUpdateEnums::Error::CannotOpenTargetFileChecksumBlocks;
     }
 
-    p_TargetFileCheckSumBlocks->seek(0);
-
-    for(zs_blockid id = 0; id < n_Blocks && !p_TargetFileCheckSumBlocks->atEnd(); ++id) {
-        rsum r = { 0, 0 };
-        unsigned char checksum[16];
-
-        /* Read on. */
-        if (p_TargetFileCheckSumBlocks->read(((char *)&r) + 4 - n_WeakCheckSumBytes, n_WeakCheckSumBytes) < 1
-                || p_TargetFileCheckSumBlocks->read((char *)&checksum, n_StrongCheckSumBytes) < 1) {
-            return QAppImageUpdateEnums::Error::QbufferIoReadError;
-        }
-
-        /* Convert to host endian and store.
-         * We need to convert from network endian to host endian ,
-         * Network endian is nothing but big endian byte order , So if we have little endian byte order ,
-         * We need to convert the data but if we have a big endian byte order ,
-         * We can simply avoid this conversion to save computation power.
-         *
-         * But most of the time we will need little endian since intel's microproccessors always follows
-         * the little endian byte order.
-        */
-        if(Q_BYTE_ORDER == Q_LITTLE_ENDIAN) {
-            r.a = qFromBigEndian(r.a);
-            r.b = qFromBigEndian(r.b);
-        }
-
-
-        /* Get hash entry with checksums for this block */
-        hash_entry *e = &(p_BlockHashes[id]);
-
-        /* Enter checksums */
-        memcpy(e->checksum, checksum, n_StrongCheckSumBytes);
-        e->r.a = r.a & p_WeakCheckSumMask;
-        e->r.b = r.b;
-
-        QCoreApplication::processEvents();
+    /*
+     * The checksum blocks start at the current position of the buffer,
+     * The control file parser hands us a view of the whole control file
+     * seeked to the checksum blocks. Decode them straight from the data of
+     * the buffer in one pass.
+    */
+    const qint32 stride = n_WeakCheckSumBytes + n_StrongCheckSumBytes;
+    const QByteArray &data = p_TargetFileCheckSumBlocks->data();
+    const qint64 pos = p_TargetFileCheckSumBlocks->pos();
+    if(data.size() - pos < stride) {
+        return QAppImageUpdateEnums::Error::InvalidTargetFileChecksumBlocks;
+    }
+    const unsigned char *record = (const unsigned char*)data.constData() + pos;
+    const zs_blockid blocks = (zs_blockid)qMin<qint64>(n_Blocks, (data.size() - pos) / stride);
+
+    /* The weak checksum is the last n_WeakCheckSumBytes of the big endian
+     * rsum, The control file parser only allows 1 to 4 bytes. */
+    switch(n_WeakCheckSumBytes) {
+    case 4:
+        decodeCheckSumBlocks<4>(record, blocks);
+        break;
+    case 3:
+        decodeCheckSumBlocks<3>(record, blocks);
+        break;
+    case 2:
+        decodeCheckSumBlocks<2>(record, blocks);
+        break;
+    default:
+        decodeCheckSumBlocks<1>(record, blocks);
+        break;
     }
+    p_TargetFileCheckSumBlocks->seek(pos + (qint64)blocks * stride);
 
     /* New checksums invalidate any existing checksum hash tables */
     if (p_RsumHash) {
         free(p_RsumHash);
         p_RsumHash = NULL;
-        free(p_BitHash);
-        p_BitHash = NULL;
+        free(p_SeedFilter);
+        p_SeedFilter = NULL;
     }
     return 0;
 }
@@ -992,25 +1250,38 @@ short ZsyncWriterPrivate::tryOpenSourceFile(const QString &filePath, QFile **sou
  * This private slot verifies if the current working target file matches
  * the final SHA1 Hash of the actual target file which resides in a remote
  * server.
- * Returns true if successfully constructed the target file.
+ * The file is hashed on the compute thread, handleTargetFileHashed
+ * constructs the target file or reports the mismatch.
 */
-bool ZsyncWriterPrivate::verifyAndConstructTargetFile() {
+void ZsyncWriterPrivate::verifyAndConstructTargetFile() {
     if(!p_TargetFile->isOpen() || !p_TargetFile->autoRemove()) {
-        return true;
+        return;
     }
 
-    bool constructed = false;
-    QString UnderConstructionFileSHA1;
     qint64 bufferSize = 0;
-    QScopedPointer<QCryptographicHash> SHA1Hasher(new QCryptographicHash(QCryptographicHash::Sha1));
+
+    /* Wait for the queued writes to reach the file before we read it. */
+    if(!p_BlockWriter->flush()) {
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
+        FATAL_START " verifyAndConstructTargetFile : cannot write the temporary target file." FATAL_END;
+        emit error(QAppImageUpdateEnums::Error::CannotWriteTargetFile);
+        return;
+    }
 
     /*
+     * The block writer already hashed the contiguous prefix of the
+     * target file as it was written, So we only have to read back
+     * the rest.
+     *
      * Truncate and Seek.
      **/
+    ZsyncPrefixHasher *SHA1Hasher = p_BlockWriter->hasher();
     p_TargetFile->resize(n_TargetFileLength);
-    p_TargetFile->seek(0);
+    p_TargetFile->seek(SHA1Hasher->prefix());
 
-    INFO_START " verifyAndConstructTargetFile : calculating sha1 hash on temporary target file. " INFO_END;
+    INFO_START " verifyAndConstructTargetFile : calculating sha1 hash on temporary target file from offset "
+    LOGR SHA1Hasher->prefix() LOGR " of " LOGR n_TargetFileLength LOGR " bytes." INFO_END;
     if(n_TargetFileLength >= 1073741824) { // 1 GiB and more.
         bufferSize = 104857600; // copy per 100 MiB.
     } else if(n_TargetFileLength >= 1048576 ) { // 1 MiB and more.
@@ -1021,11 +1292,40 @@ bool ZsyncWriterPrivate::verifyAndConstructTargetFile() {
         bufferSize = 1024; // copy per 1 KiB.
     }
 
-    while(!p_TargetFile->atEnd()) {
-        SHA1Hasher->addData(p_TargetFile->read(bufferSize));
-        QCoreApplication::processEvents();
+    /*
+     * Read the rest back on the compute thread, Nothing else touches the
+     * target file or the hasher until handleTargetFileHashed. The event
+     * loop of this thread keeps running meanwhile.
+    */
+    b_Scanning = true;
+    const qint32 id = n_ComputeId;
+    p_ComputePool->start(new FunctionRunnable([this, SHA1Hasher, bufferSize, id]() {
+        while(!p_TargetFile->atEnd() && !isCancelRequested()) {
+            SHA1Hasher->addData(p_TargetFile->read(bufferSize));
+        }
+        QString sha1 = isCancelRequested() ? QString() : QString(SHA1Hasher->result().toHex().toUpper());
+        QMetaObject::invokeMethod(this, "handleTargetFileHashed",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QString, sha1),
+                                  Q_ARG(qint32, id));
+    }));
+}
+
+/* Finishes verifyAndConstructTargetFile once the compute thread hashed the
+ * target file, An empty hash means the update was canceled meanwhile. */
+void ZsyncWriterPrivate::handleTargetFileHashed(QString UnderConstructionFileSHA1, qint32 id) {
+    if(id != n_ComputeId) {
+        return;
+    }
+    b_Scanning = false;
+
+    if(UnderConstructionFileSHA1.isEmpty()) {
+        INFO_START " handleTargetFileHashed : canceled." INFO_END;
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
+        emit canceled();
+        return;
     }
-    UnderConstructionFileSHA1 = QString(SHA1Hasher->result().toHex().toUpper());
 
     INFO_START " verifyAndConstructTargetFile : comparing temporary target file sha1 hash(" LOGR UnderConstructionFileSHA1
     LOGR ") and remote target file sha1 hash(" LOGR s_TargetFileSHA1 INFO_END;
@@ -1033,7 +1333,8 @@ bool ZsyncWriterPrivate::verifyAndConstructTargetFile() {
     if(UnderConstructionFileSHA1 == s_TargetFileSHA1) {
         INFO_START " verifyAndConstructTargetFile : sha1 hash matches!" INFO_END;
         QString newTargetFileName;
-        p_TargetFile->setAutoRemove(!(constructed = true));
+        removeJournal();
+        p_TargetFile->setAutoRemove(false);
         /*
          * Rename the new version with current time stamp.
          * Do not touch anything else.
@@ -1064,10 +1365,12 @@ bool ZsyncWriterPrivate::verifyAndConstructTargetFile() {
         p_TargetFile->setPermissions(QFileInfo(s_SourceFilePath).permissions());
         p_TargetFile->close();
     } else {
-        b_Started = b_CancelRequested = false;
+        removeJournal();
+        b_Started = false;
+        m_CancelToken.storeRelease(0);
         FATAL_START " verifyAndConstructTargetFile : sha1 hash mismatch." FATAL_END;
         emit error(QAppImageUpdateEnums::Error::TargetFileSha1HashMismatch);
-        return constructed;
+        return;
     }
 
     /*
@@ -1078,16 +1381,37 @@ bool ZsyncWriterPrivate::verifyAndConstructTargetFile() {
         {"AbsolutePath", QFileInfo(p_TargetFile->fileName()).absoluteFilePath() },
         {"Sha1Hash", UnderConstructionFileSHA1},
         {"UsedTorrent", b_TorrentAvail && b_AcceptRange},
-	{"TorrentFileUrl", u_TorrentFileUrl.isValid() ? u_TorrentFileUrl.toString() : ""}
+	{"TorrentFileUrl", u_TorrentFileUrl.isValid() ? u_TorrentFileUrl.toString() : ""},
+        {"NeededRanges", n_NeededRanges},
+        {"RequestedRanges", n_RequestedRanges},
+        {"RedundantBytes", n_RedundantBytes},
+        {"CoalesceGapThreshold", n_GapThreshold}
     };
-    b_Started = b_CancelRequested = false;
+    b_Started = false;
+    m_CancelToken.storeRelease(0);
     emit finished(newVersionDetails, s_SourceFilePath);
-    return constructed;
 }
 
-/* Given a hash table entry, check the data in this block against every entry
- * in the linked list for this hash entry, checking the checksums for this
- * block against those recorded in the hash entries.
+/* rsum of a block as stored in the slots of the rsum hash table. */
+static inline quint32 rsum_key(rsum r, unsigned short mask) {
+    return ((quint32)(r.a & mask) << 16) | r.b;
+}
+
+/* Seed filter hash of a window with the given rsum keys, key1 is the key
+ * of the following window when we need sequential matches, else 0.
+ * The high 32 bits select the filter block and the low bits the probes. */
+static inline quint64 seed_filter_hash(quint32 key0, quint32 key1) {
+    quint64 h = ((quint64)key0 << 32) | key1;
+    h ^= h >> 31;
+    h *= 0x9E3779B97F4A7C15ull;
+    h ^= h >> 29;
+    return h;
+}
+
+/* Given a block id, check the data in this block against that block, Else
+ * if nextMatch is -1, against every block in the rsum hash table with the
+ * same rsum as this block, checking the checksums for this block against
+ * those recorded for the target blocks.
  *
  * If we get a hit (checksums match a desired block), write the data to that
  * block in the target file and update our state accordingly to indicate that
@@ -1095,104 +1419,122 @@ bool ZsyncWriterPrivate::verifyAndConstructTargetFile() {
  *
  * Return the number of blocks successfully obtained.
  */
-qint32 ZsyncWriterPrivate::checkCheckSumsOnHashChain(const struct hash_entry *e, const unsigned char *data,int onlyone) {
+qint32 ZsyncWriterPrivate::checkCheckSumsOnHashChain(zs_blockid nextMatch, const unsigned char *data) {
     unsigned char md4sum[2][CHECKSUM_SIZE];
-    signed int done_md4 = -1;
+    qint32 done_md4 = -1;
     qint32 got_blocks = 0;
     rsum rs = p_CurrentWeakCheckSums.first;
 
     /* This is a hint to the caller that they should try matching the next
-     * block against a particular hash entry (because at least n_SeqMatches
+     * block against a particular block (because at least n_SeqMatches
      * prior blocks to it matched in sequence). Clear it here and set it below
      * if and when we get such a set of matches. */
-    p_NextMatch = NULL;
-
-    /* This is essentially a for (;e;e=e->next), but we want to remove links from
-     * the list as we find matches, without keeping too many temp variables.
-     */
-    p_Rover = e;
-    while (p_Rover) {
-        zs_blockid id;
-
-        e = p_Rover;
-        p_Rover = onlyone ? NULL : e->next;
+    n_NextMatch = -1;
 
-        /* Check weak checksum first */
+    if (nextMatch >= 0) {
+        if (p_BlockRsums[nextMatch].a != (rs.a & p_WeakCheckSumMask) || p_BlockRsums[nextMatch].b != rs.b) {
+            return 0;
+        }
+        return checkStrongCheckSums(nextMatch, data, true, md4sum, &done_md4);
+    }
 
-        // HashHit++
-        if (e->r.a != (rs.a & p_WeakCheckSumMask) || e->r.b != rs.b) {
+    /* Walk all the slots with the same key, Blocks we write are marked as
+     * removed in place so the walk is not disturbed by them. */
+    const quint32 key = rsum_key(rs, p_WeakCheckSumMask);
+    bool weakHit = false;
+    for (quint32 slot = hashSlot(key);
+            p_RsumHash[slot].id != HASH_SLOT_EMPTY;
+            slot = (slot + 1) & p_HashMask) {
+        const zs_blockid id = p_RsumHash[slot].id;
+        if (id < 0 || rsum_key(p_BlockRsums[id], p_WeakCheckSumMask) != key) {
             continue;
         }
 
-        id = getHashEntryBlockId( e);
+        // HashHit++
 
-        if (!onlyone && n_SeqMatches > 1
-                && (p_BlockHashes[id + 1].r.a != (p_CurrentWeakCheckSums.second.a & p_WeakCheckSumMask)
-                    || p_BlockHashes[id + 1].r.b != p_CurrentWeakCheckSums.second.b))
+        if (n_SeqMatches > 1
+                && (p_BlockRsums[id + 1].a != (p_CurrentWeakCheckSums.second.a & p_WeakCheckSumMask)
+                    || p_BlockRsums[id + 1].b != p_CurrentWeakCheckSums.second.b))
             continue;
 
         // WeakHit++
+        weakHit = true;
+        got_blocks += checkStrongCheckSums(id, data, false, md4sum, &done_md4);
+    }
 
-        {
-            int ok = 1;
-            signed int check_md4 = 0;
-            zs_blockid next_known = -1;
-
-            /* This block at least must match; we must match at least
-             * n_SeqMatches-1 others, which could either be trailing stuff,
-             * or these could be preceding blocks that we have verified
-             * already. */
-            do {
-                /* We only calculate the MD4 once we need it; but need not do so twice */
-                if (check_md4 > done_md4) {
-                    calcMd4Checksum(&md4sum[check_md4][0],
-                                    data + n_BlockSize * check_md4,
-                                    n_BlockSize);
-                    done_md4 = check_md4;
-                    // Checksummed++
-                }
-
-                /* Now check the strong checksum for this block */
-                if (memcmp(&md4sum[check_md4],
-                           &p_BlockHashes[id + check_md4].checksum[0],
-                           n_StrongCheckSumBytes)) {
-                    ok = 0;
-                } else if (next_known == -1) {
-                }
-                check_md4++;
-                QCoreApplication::processEvents();
-            } while (ok && !onlyone && check_md4 < n_SeqMatches);
+    /* We are only called on a seed filter hit. */
+    if (!weakHit) {
+        n_SeedFilterFalseHits.fetchAndAddRelaxed(1);
+    }
+    return got_blocks;
+}
 
-            if (ok) {
-                qint32 num_write_blocks;
-
-                /* Find the next block that we already have data for. If this
-                 * is part of a run of matches then we have this stored already
-                 * as ->next_known. */
-                zs_blockid next_known = onlyone ? n_NextKnown : nextKnownBlock( id);
-
-                // stronghit++
-
-                if (next_known > id + check_md4) {
-                    num_write_blocks = check_md4;
-
-                    /* Save state for this run of matches */
-                    p_NextMatch = &(p_BlockHashes[id + check_md4]);
-                    if (!onlyone) n_NextKnown = next_known;
-                } else {
-                    /* We've reached the EOF, or data we already know. Just
-                     * write out the blocks we don't know, and that's the end
-                     * of this run of matches. */
-                    num_write_blocks = next_known - id;
-                }
+/* Checks the strong checksums of the data against the block id (and the
+ * block after it if we need sequential matches), Writes the matched blocks
+ * we don't yet have.
+ *
+ * md4sum and done_md4 cache the checksums of the data across the calls for
+ * the same data.
+ *
+ * Return the number of blocks written.
+ */
+qint32 ZsyncWriterPrivate::checkStrongCheckSums(zs_blockid id, const unsigned char *data, bool onlyone,
+        unsigned char (*md4sum)[CHECKSUM_SIZE], qint32 *done_md4) {
+    int ok = 1;
+    signed int check_md4 = 0;
+
+    /* This block at least must match; we must match at least
+     * n_SeqMatches-1 others, which could either be trailing stuff,
+     * or these could be preceding blocks that we have verified
+     * already. */
+    do {
+        /* We only calculate the MD4 once we need it; but need not do so twice */
+        if (check_md4 > *done_md4) {
+            md4_digest(data + n_BlockSize * check_md4,
+                       n_BlockSize,
+                       &md4sum[check_md4][0]);
+            *done_md4 = check_md4;
+            // Checksummed++
+        }
 
-                /* Write out the matched blocks that we don't yet know */
-                writeBlocks( data, id, id + num_write_blocks - 1);
-                got_blocks += num_write_blocks;
-            }
+        /* Now check the strong checksum for this block */
+        if (memcmp(&md4sum[check_md4],
+                   blockCheckSum(id + check_md4),
+                   n_StrongCheckSumBytes)) {
+            ok = 0;
         }
+        check_md4++;
+    } while (ok && !onlyone && check_md4 < n_SeqMatches);
+
+    if (!ok) {
+        return 0;
     }
-    return got_blocks;
+
+    qint32 num_write_blocks;
+
+    /* Find the next block that we already have data for. If this
+     * is part of a run of matches then we have this stored already
+     * as ->next_known. */
+    zs_blockid next_known = onlyone ? n_NextKnown : nextKnownBlock( id);
+
+    // stronghit++
+
+    if (next_known > id + check_md4) {
+        num_write_blocks = check_md4;
+
+        /* Save state for this run of matches */
+        n_NextMatch = id + check_md4;
+        if (!onlyone) n_NextKnown = next_known;
+    } else {
+        /* We've reached the EOF, or data we already know. Just
+         * write out the blocks we don't know, and that's the end
+         * of this run of matches. */
+        num_write_blocks = next_known - id;
+    }
+
+    /* Write out the matched blocks that we don't yet know */
+    writeBlocks( data, id, id + num_write_blocks - 1);
+    return num_write_blocks;
 }
 
 /* Reads the supplied data (length datalen) and identifies any contained blocks
@@ -1213,7 +1555,7 @@ qint32 ZsyncWriterPrivate::checkCheckSumsOnHashChain(const struct hash_entry *e,
  * p_CurrentWeakCheckSums.first - rolling checksum of the first blocksize bytes of the buffer
  * p_CurrentWeakCheckSums.second - rolling checksum of the next blocksize bytes of the buffer (if n_SeqMatches > 1)
  */
-qint32 ZsyncWriterPrivate::submitSourceData(unsigned char *data,size_t len, off_t offset) {
+qint32 ZsyncWriterPrivate::submitSourceData(const unsigned char *data,size_t len, off_t offset) {
     /* The window in data[] currently being considered is
      * [x, x+bs)
      */
@@ -1224,7 +1566,14 @@ qint32 ZsyncWriterPrivate::submitSourceData(unsigned char *data,size_t len, off_
     if (offset) {
         x = n_Skip;
     } else {
-        p_NextMatch = NULL;
+        n_NextMatch = -1;
+    }
+
+    /* The skip can take us past all the window positions of a short
+     * buffer, So carry the rest of it to the next buffer. */
+    if ((size_t)(x + n_Context) > len) {
+        n_Skip = x + n_Context - len;
+        return got_blocks;
     }
 
     if (x || !offset) {
@@ -1237,7 +1586,7 @@ qint32 ZsyncWriterPrivate::submitSourceData(unsigned char *data,size_t len, off_
     /* Work through the block until the current blocksize bytes being
      * considered, starting at x, is at the end of the buffer */
     for (;;) {
-        if ((size_t)(x + n_Context) == len) {
+        if ((size_t)(x + n_Context) >= len) {
             return got_blocks;
         }
         {
@@ -1251,25 +1600,23 @@ qint32 ZsyncWriterPrivate::submitSourceData(unsigned char *data,size_t len, off_
             /* If the previous block was a match, but we're looking for
              * sequential matches, then test this block against the block in
              * the target immediately after our previous hit. */
-            if (p_NextMatch && n_SeqMatches > 1) {
-                if (0 != (thismatch = checkCheckSumsOnHashChain( p_NextMatch, data + x, 1))) {
+            if (n_NextMatch >= 0 && n_SeqMatches > 1) {
+                if (0 != (thismatch = checkCheckSumsOnHashChain( n_NextMatch, data + x))) {
                     blocks_matched = 1;
                 }
             }
             if (!thismatch) {
-                const struct hash_entry *e;
+                compactHash();
 
-                /* Do a hash table lookup - first in the p_BitHash (fast negative
+                /* Do a hash table lookup - first in the p_SeedFilter (fast negative
                  * check) and then in the rsum hash */
-                unsigned hash = p_CurrentWeakCheckSums.first.b;
-                hash ^= ((n_SeqMatches > 1) ? p_CurrentWeakCheckSums.second.b
-                         : p_CurrentWeakCheckSums.first.a & p_WeakCheckSumMask) << BITHASHBITS;
-                if ((p_BitHash[(hash & p_BitHashMask) >> 3] & (1 << (hash & 7))) != 0
-                        && (e = p_RsumHash[hash & p_HashMask]) != NULL) {
+                quint64 hash = seed_filter_hash(rsum_key(p_CurrentWeakCheckSums.first, p_WeakCheckSumMask),
+                                                (n_SeqMatches > 1) ? rsum_key(p_CurrentWeakCheckSums.second, p_WeakCheckSumMask) : 0);
+                if (seedFilterContains(hash)) {
 
                     /* Okay, we have a hash hit. Follow the hash chain and
                      * check our block against all the entries. */
-                    thismatch = checkCheckSumsOnHashChain( e, data + x, 0);
+                    thismatch = checkCheckSumsOnHashChain( -1, data + x);
                     if (thismatch)
                         blocks_matched = n_SeqMatches;
                 }
@@ -1303,49 +1650,542 @@ qint32 ZsyncWriterPrivate::submitSourceData(unsigned char *data,size_t len, off_
             }
         }
 
-        /* Else - advance the window by 1 byte - update the rolling checksum
-         * and our offset in the buffer */
+        /* Else - advance the window to the next position which passes the
+         * p_SeedFilter check (or to the end of the buffer) - updating the
+         * rolling checksums and our offset in the buffer */
         {
-            unsigned char Nc = data[x + bs * 2];
-            unsigned char nc = data[x + bs];
-            unsigned char oc = data[x];
-            UPDATE_RSUM(p_CurrentWeakCheckSums.first.a, p_CurrentWeakCheckSums.first.b, oc, nc, n_BlockShift);
-            if (n_SeqMatches > 1)
-                UPDATE_RSUM(p_CurrentWeakCheckSums.second.a, p_CurrentWeakCheckSums.second.b, nc, Nc, n_BlockShift);
+            rsum r[2] = { p_CurrentWeakCheckSums.first, p_CurrentWeakCheckSums.second };
+            x += rollToCandidate(data + x, len - n_Context - x, r);
+            p_CurrentWeakCheckSums.first = r[0];
+            p_CurrentWeakCheckSums.second = r[1];
         }
-        x++;
     }
 }
 
 /* Read the given stream, applying the rsync rolling checksum algorithm to
  * identify any blocks of data in common with the target file. Blocks found are
  * written to our working target output.
+ *
+ * The seed is memory mapped when possible so that the scan can walk it
+ * without any copies or read calls, else it is read through the file.
  */
 qint32 ZsyncWriterPrivate::submitSourceFile(QFile *file) {
     if(!file) {
         return 0;
     }
 
-    qint32 error = 0;
-    off_t in = 0;
-    /* Allocate buffer of 16 blocks */
-    qint32 bufsize = n_BlockSize * 16;
-    unsigned char *buf = (unsigned char*)malloc(bufsize + n_Context);
-    if (!buf)
-        return (error = -1);
-
     /* Build checksum hash tables ready to analyse the blocks we find */
     if (!p_RsumHash) {
         if (!buildHash()) {
-            free(buf);
-            return (error = -2);
+            return -2;
+        }
+    }
+
+    qint32 error = 0;
+    const qint64 fileLength = file->size();
+    /* Large seeds are scanned on all the cores we have. */
+    const bool parallel = n_ScanThreads > 1 && fileLength > SEED_SCAN_CHUNK_SIZE;
+
+    unsigned char *map = (fileLength > 0) ? file->map(0, fileLength) : nullptr;
+    if (map) {
+        madvise(map, fileLength, MADV_SEQUENTIAL);
+        QVector<QPair<qint64, qint64>> regions = submitAlignedSource(map, fileLength);
+        if (seedScanCanceled()) {
+            error = -3;
+        } else if (n_BytesWritten < n_TargetFileLength) {
+            error = parallel ? submitMappedSourceParallel(map, fileLength, regions)
+                    : submitMappedSource(map, fileLength, regions);
         }
+        file->unmap(map);
+    } else {
+        INFO_START " submitSourceFile : cannot map seed file, reading it instead." INFO_END;
+        posix_fadvise(file->handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+        error = parallel ? submitSourceFileParallel(file) : submitSourceStream(file);
     }
 
+    {
+        qint64 probes = n_SeedFilterProbes.load(),
+               falseHits = n_SeedFilterFalseHits.load();
+        double rate = probes ? (double)falseHits / (double)probes : 0.0;
+        INFO_START " submitSourceFile : seed filter false positive rate " LOGR rate
+        LOGR " (" LOGR falseHits LOGR " of " LOGR probes LOGR " windows)." INFO_END;
+    }
 
     p_TransferSpeed.reset(new QElapsedTimer);
-    p_TransferSpeed->start();
-    while (!file->atEnd()) {
+    file->close();
+    return error;
+}
+
+/*
+ * Scans the source file and the given extra seeds against the same hash
+ * tables. The seeds are memory mapped and ranked by their sampled overlap
+ * with the blocks we still need, Then their chunks are handed to the
+ * workers best seed first. As in submitMappedSourceParallel the workers
+ * only read the hash tables and the matches are merged by this thread after
+ * each batch, in batch order.
+ * All seeds stop as soon as we have the entire target file, So the worse
+ * seeds are often never scanned at all.
+ *
+ * Extra seeds which cannot be opened are skipped, Seeds which cannot be
+ * mapped are scanned with submitSourceFile afterwards.
+ * Returns the same as submitSourceFile.
+ */
+qint32 ZsyncWriterPrivate::submitSourceFiles(QFile *sourceFile, const QStringList &extraSeedFiles) {
+    /* Build checksum hash tables ready to analyse the blocks we find */
+    if (!p_RsumHash) {
+        if (!buildHash()) {
+            return -2;
+        }
+    }
+
+    struct Seed {
+        QFile *file;
+        const unsigned char *map;
+        qint64 length,
+               tailStart,
+               pos;          /* next window position to hand out. */
+        QByteArray tail;     /* last bytes of the seed, zero padded. */
+        bool tailDone;
+        qint64 overlap;      /* estimated no. of bytes of the target in the seed. */
+        QVector<QPair<qint64, qint64>> regions; /* window positions left after the aligned pass. */
+        int region;          /* region pos is in. */
+    };
+    struct Job {
+        const unsigned char *base; /* buffer the match offsets refer to. */
+        qint64 from,
+               to;
+    };
+
+    QList<QSharedPointer<QFile>> files;
+    files << QSharedPointer<QFile>(sourceFile, [](QFile*) { });
+    for(auto iter = extraSeedFiles.constBegin(),
+            end = extraSeedFiles.constEnd();
+            iter != end;
+            ++iter) {
+        QFile *file = nullptr;
+        if(tryOpenSourceFile(*iter, &file) > 0) {
+            WARNING_START " submitSourceFiles : cannot open seed file " LOGR *iter LOGR ", skipping it." WARNING_END;
+            continue;
+        }
+        files << QSharedPointer<QFile>(file);
+    }
+
+    QVector<Seed> seeds;
+    QList<QFile*> unmapped;
+    for(auto iter = files.constBegin(),
+            end = files.constEnd();
+            iter != end;
+            ++iter) {
+        QFile *file = (*iter).data();
+        const qint64 length = file->size();
+        unsigned char *map = (length > 0) ? file->map(0, length) : nullptr;
+        if (!map) {
+            unmapped << file;
+            continue;
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+        seeds.append({ file, map, length, qMax<qint64>(0, length - n_Context), 0, QByteArray(), false,
+                       estimateSeedOverlap(map, length), QVector<QPair<qint64, qint64>>(), 0 });
+        INFO_START " submitSourceFiles : seed " LOGR file->fileName() LOGR " has about "
+        LOGR seeds.last().overlap LOGR " bytes of the target." INFO_END;
+    }
+
+    /* Best first, The source file wins a tie. */
+    std::stable_sort(seeds.begin(), seeds.end(), [](const Seed &a, const Seed &b) {
+        return a.overlap > b.overlap;
+    });
+
+    /* Take the unchanged blocks first, Then only roll through the rest. */
+    for (auto iter = seeds.begin(); iter != seeds.end() && n_BytesWritten < n_TargetFileLength; ++iter) {
+        (*iter).regions = submitAlignedSource((*iter).map, (*iter).length);
+    }
+
+    const int threads = n_ScanThreads;
+    const qint64 chunkSize = ((SEED_SCAN_CHUNK_SIZE + n_BlockSize - 1) / n_BlockSize) * n_BlockSize;
+
+    INFO_START " submitSourceFiles : scanning " LOGR files.size() LOGR " seed files with " LOGR threads LOGR " threads." INFO_END;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QVector<QVector<zs_match>> matches(threads);
+    QVector<Job> jobs;
+
+    p_TransferSpeed.reset(new QElapsedTimer);
+    p_TransferSpeed->start();
+
+    qint32 error = 0;
+    while (!seeds.isEmpty() && n_BytesWritten < n_TargetFileLength) {
+        /* Fill the batch from the best seed which has chunks left. */
+        jobs.clear();
+        for (int i = 0; jobs.size() < threads && i < seeds.size();) {
+            Seed &seed = seeds[i];
+            if (seed.region < seed.regions.size()) {
+                const qint64 end = qMin(seed.regions.at(seed.region).second, seed.tailStart);
+                seed.pos = qMax(seed.pos, seed.regions.at(seed.region).first);
+                if (seed.pos >= end) {
+                    ++seed.region;
+                    continue;
+                }
+                qint64 to = qMin(seed.pos + chunkSize, end);
+                jobs.append({ seed.map, seed.pos, to });
+                seed.pos = to;
+            } else if (!seed.tailDone) {
+                seed.tailDone = true;
+                seed.tail = padSeedTail(seed.map + seed.tailStart, seed.length - seed.tailStart);
+                jobs.append({ (const unsigned char*)seed.tail.constData(), 0, seed.length - seed.tailStart });
+            } else {
+                ++i;
+            }
+        }
+        if (jobs.isEmpty()) {
+            break;
+        }
+
+        for (int i = 0; i < jobs.size(); ++i) {
+            const Job job = jobs.at(i);
+            QVector<zs_match> *result = &matches[i];
+            result->clear();
+            pool.start(new FunctionRunnable([this, job, result]() {
+                scanSourceChunk(job.base + job.from, job.to - job.from, job.from, result);
+            }));
+        }
+        pool.waitForDone();
+
+        for (int i = 0; i < jobs.size(); ++i) {
+            mergeSourceMatches(jobs.at(i).base, matches.at(i));
+        }
+
+        emitSeedProgress();
+        if (seedScanCanceled()) {
+            error = -3;
+            break;
+        }
+    }
+
+    for (auto iter = seeds.begin(); iter != seeds.end(); ++iter) {
+        (*iter).file->unmap((unsigned char*)(*iter).map);
+        (*iter).file->close();
+    }
+
+    for (auto iter = unmapped.constBegin();
+            error == 0 && iter != unmapped.constEnd() && n_BytesWritten < n_TargetFileLength;
+            ++iter) {
+        INFO_START " submitSourceFiles : cannot map seed file, reading it instead." INFO_END;
+        error = submitSourceFile(*iter);
+    }
+    return error;
+}
+
+/*
+ * First pass over a memory mapped seed, Checks every seed block against the
+ * target block at the same offset. This finds the parts of the target which
+ * did not change or move without rolling through them.
+ * The weak checksums are compared first and the blocks which pass are
+ * hashed with the multi buffer MD4 a batch at a time. As in the rolling
+ * scan, Only runs of at least n_SeqMatches matching blocks are taken.
+ *
+ * Returns the window positions which the rolling scan still has to look
+ * at, As half open ranges in seed order. A window is left out only if it
+ * lies entirely within the blocks taken here.
+ */
+QVector<QPair<qint64, qint64>> ZsyncWriterPrivate::submitAlignedSource(const unsigned char *map, qint64 length) {
+    const zs_blockid blocks = (zs_blockid)qMin<qint64>(n_Blocks, (length + n_BlockSize - 1) >> n_BlockShift);
+    QVector<QPair<qint64, qint64>> regions;
+    QVector<QPair<zs_blockid, zs_blockid>> taken;
+
+    /* The last block of the seed zero padded, if it is short. */
+    QByteArray lastBlock;
+    auto blockData = [&](zs_blockid id) -> const unsigned char* {
+        qint64 offset = ((qint64)id) << n_BlockShift;
+        if (offset + n_BlockSize <= length) {
+            return map + offset;
+        }
+        if (lastBlock.isEmpty()) {
+            lastBlock.fill('\0', n_BlockSize);
+            memcpy(lastBlock.data(), map + offset, length - offset);
+        }
+        return (const unsigned char*)lastBlock.constData();
+    };
+
+    /* Writes the run [from, to] if it is long enough, Or if it continues
+     * a run which was long enough. */
+    auto takeRun = [&](zs_blockid from, zs_blockid to, bool continued) {
+        if (from < 0 || (!continued && to - from + 1 < n_SeqMatches)) {
+            return;
+        }
+        if ((((qint64)to + 1) << n_BlockShift) > length) {
+            if (to > from) {
+                writeBlocks(blockData(from), from, to - 1);
+            }
+            writeBlocks(blockData(to), to, to);
+        } else {
+            writeBlocks(blockData(from), from, to);
+        }
+        taken.append(qMakePair(from, to));
+    };
+
+    QVector<const unsigned char*> candidates(ALIGNED_SCAN_BATCH);
+    QVector<zs_blockid> ids(ALIGNED_SCAN_BATCH);
+    QVector<unsigned char> md4sums(ALIGNED_SCAN_BATCH * CHECKSUM_SIZE);
+    zs_blockid runStart = -1,
+               runEnd = -1;
+    bool runContinued = false;
+    for (zs_blockid batch = 0; batch < blocks && !seedScanCanceled(); batch += ALIGNED_SCAN_BATCH) {
+        const zs_blockid end = qMin<zs_blockid>(batch + ALIGNED_SCAN_BATCH, blocks);
+        qint32 n = 0;
+        for (zs_blockid id = batch; id < end; ++id) {
+            if (alreadyGotBlock(id)) {
+                continue;
+            }
+            rsum r = calc_rsum_block(blockData(id), n_BlockSize);
+            if ((r.a & p_WeakCheckSumMask) != p_BlockRsums[id].a || r.b != p_BlockRsums[id].b) {
+                continue;
+            }
+            candidates[n] = blockData(id);
+            ids[n] = id;
+            ++n;
+        }
+        md4_digest_many(candidates.constData(), n_BlockSize, n, md4sums.data());
+
+        qint32 k = 0;
+        for (zs_blockid id = batch; id < end; ++id) {
+            bool ok = false;
+            if (k < n && ids.at(k) == id) {
+                ok = !memcmp(md4sums.constData() + k * CHECKSUM_SIZE,
+                             blockCheckSum(id),
+                             n_StrongCheckSumBytes);
+                ++k;
+            }
+            if (ok) {
+                runStart = (runStart < 0) ? id : runStart;
+                runEnd = id;
+
+                /* Write long runs SEED_SCAN_CHUNK_SIZE bytes at a time, A
+                 * seed which is almost the target would else be written
+                 * in one go at the end. */
+                if (runEnd - runStart + 1 >= n_SeqMatches
+                        && (((qint64)(runEnd - runStart + 1)) << n_BlockShift) >= SEED_SCAN_CHUNK_SIZE) {
+                    takeRun(runStart, runEnd, runContinued);
+                    runStart = -1;
+                    runContinued = true;
+                }
+            } else {
+                takeRun(runStart, runEnd, runContinued);
+                runStart = -1;
+                runContinued = false;
+            }
+        }
+        emitSeedProgress();
+    }
+    takeRun(runStart, runEnd, runContinued);
+
+    /* The target may need a taken block at other offsets too, So look up
+     * the windows at the taken blocks once like the rolling scan would. */
+    QVector<zs_match> duplicates;
+    for (auto iter = taken.constBegin(); iter != taken.constEnd(); ++iter) {
+        for (zs_blockid id = (*iter).first; id <= (*iter).second; ++id) {
+            const qint64 offset = ((qint64)id) << n_BlockShift;
+            if (offset + n_Context > length) {
+                break;
+            }
+            scanSourceChunk(map + offset, 1, offset, &duplicates);
+        }
+    }
+    mergeSourceMatches(map, duplicates);
+
+    /* The windows which overlap a gap between the taken runs. */
+    qint64 gapStart = 0,
+           takenBytes = 0;
+    auto addGap = [&](qint64 gapEnd) {
+        if (gapEnd <= gapStart) {
+            return;
+        }
+        qint64 from = qMax<qint64>(0, gapStart - n_Context + 1);
+        if (!regions.isEmpty() && from <= regions.last().second) {
+            regions.last().second = gapEnd;
+        } else {
+            regions.append(qMakePair(from, gapEnd));
+        }
+    };
+    for (auto iter = taken.constBegin(); iter != taken.constEnd(); ++iter) {
+        addGap(((qint64)(*iter).first) << n_BlockShift);
+        gapStart = ((qint64)(*iter).second + 1) << n_BlockShift;
+        takenBytes += ((qint64)((*iter).second - (*iter).first + 1)) << n_BlockShift;
+    }
+    addGap(length);
+
+    INFO_START " submitAlignedSource : took " LOGR takenBytes LOGR " bytes at their own offsets in "
+    LOGR taken.size() LOGR " runs." INFO_END;
+    return regions;
+}
+
+/*
+ * Estimates how many bytes of the blocks we still need are in the given
+ * memory mapped seed, Without scanning all of it. Block aligned windows
+ * spread over the seed are looked up as they are and a few short stretches
+ * are rolled through, Which also finds blocks at unaligned offsets.
+ * The estimate is the fraction of samples with a match times the seed
+ * length.
+ */
+qint64 ZsyncWriterPrivate::estimateSeedOverlap(const unsigned char *map, qint64 length) const {
+    /* Windows with n_Context bytes after them in the seed. */
+    const qint64 positions = length - n_Context;
+    if (positions <= 0) {
+        return 0;
+    }
+
+    QVector<zs_match> found;
+    qint32 samples = 0,
+           hits = 0;
+
+    const qint64 seedBlocks = (positions - 1) / n_BlockSize + 1;
+    const qint64 aligned = qMin<qint64>(SEED_SAMPLE_ALIGNED, seedBlocks);
+    for (qint64 k = 0; k < aligned; ++k) {
+        qint64 offset = ((k * seedBlocks) / aligned) << n_BlockShift;
+        found.clear();
+        scanSourceChunk(map + offset, 1, offset, &found);
+        hits += !found.isEmpty();
+        ++samples;
+    }
+
+    const qint64 span = qMin<qint64>(n_BlockSize, positions);
+    for (qint64 k = 0; k < SEED_SAMPLE_ROLLING; ++k) {
+        qint64 offset = ((2 * k + 1) * (positions - span)) / (2 * SEED_SAMPLE_ROLLING);
+        found.clear();
+        scanSourceChunk(map + offset, span, offset, &found);
+        hits += !found.isEmpty();
+        ++samples;
+    }
+    return (qint64)((double)hits / samples * length);
+}
+
+/* Scans the given window positions of a memory mapped seed of the given
+ * length with submitSourceData, SEED_SCAN_CHUNK_SIZE bytes at a time. Only
+ * the last n_Context bytes of the seed are copied, to zero pad the last
+ * block. */
+qint32 ZsyncWriterPrivate::submitMappedSource(const unsigned char *map, qint64 length,
+        const QVector<QPair<qint64, qint64>> &regions) {
+    const qint64 tailStart = qMax<qint64>(0, length - n_Context);
+    qint64 scannedTo = -1; /* end of the last window positions scanned. */
+
+    p_TransferSpeed.reset(new QElapsedTimer);
+    p_TransferSpeed->start();
+    for (auto iter = regions.constBegin(); iter != regions.constEnd(); ++iter) {
+        const qint64 end = qMin((*iter).second, tailStart);
+        for (qint64 pos = (*iter).first; pos < end;) {
+            qint64 positions = qMin(SEED_SCAN_CHUNK_SIZE, end - pos);
+            /* submitSourceData starts afresh at offset 0, Which we need at
+             * the start of every region. */
+            submitSourceData(map + pos, positions + n_Context, (pos == (*iter).first) ? 0 : pos);
+            pos += positions;
+            scannedTo = pos;
+
+            emitSeedProgress();
+            if (seedScanCanceled()) {
+                return -3;
+            }
+        }
+    }
+
+    /* The tail continues the rolling state only if the scan stopped right
+     * before it, Else the last region ended earlier and we start afresh. */
+    QByteArray tail = padSeedTail(map + tailStart, length - tailStart);
+    submitSourceData((const unsigned char*)tail.constData(), tail.size(), (scannedTo == tailStart) ? tailStart : 0);
+    emitSeedProgress();
+    return 0;
+}
+
+/* Same as submitMappedSource but the seed is split into chunks which are
+ * scanned by worker threads, a batch of chunks at a time.
+ *
+ * Each chunk is scanned along with the n_Context bytes that follow it so
+ * that windows crossing a chunk boundary are still seen.
+ * The workers only read the hash tables and record what they find, the
+ * matches are written to the target file by this thread after all workers
+ * of a batch are done, in chunk order and then in seed offset order. So the
+ * resulting target file and known ranges do not depend on the scheduling of
+ * the workers.
+ */
+qint32 ZsyncWriterPrivate::submitMappedSourceParallel(const unsigned char *map, qint64 length,
+        const QVector<QPair<qint64, qint64>> &regions) {
+    const int threads = n_ScanThreads;
+    const qint64 chunkSize = ((SEED_SCAN_CHUNK_SIZE + n_BlockSize - 1) / n_BlockSize) * n_BlockSize;
+    const qint64 tailStart = qMax<qint64>(0, length - n_Context);
+
+    /* Cut the regions into chunks, One chunk per worker in a batch. */
+    QVector<QPair<qint64, qint64>> chunks;
+    for (auto iter = regions.constBegin(); iter != regions.constEnd(); ++iter) {
+        const qint64 end = qMin((*iter).second, tailStart);
+        for (qint64 from = (*iter).first; from < end; from += chunkSize) {
+            chunks.append(qMakePair(from, qMin(from + chunkSize, end)));
+        }
+    }
+
+    INFO_START " submitMappedSourceParallel : scanning seed with " LOGR threads LOGR " threads." INFO_END;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QVector<QVector<zs_match>> matches(threads);
+
+    p_TransferSpeed.reset(new QElapsedTimer);
+    p_TransferSpeed->start();
+
+    for (int c = 0; c < chunks.size(); c += threads) {
+        const int n = qMin(threads, chunks.size() - c);
+
+        /* Let the kernel read the next batch while we scan this one. */
+        if (c + n < chunks.size()) {
+            qint64 ahead = qMin(chunks.at(qMin(c + 2 * n, chunks.size()) - 1).second + n_Context, length);
+            qint64 pageStart = chunks.at(c + n).first & ~((qint64)getpagesize() - 1);
+            madvise((void*)(map + pageStart), ahead - pageStart, MADV_WILLNEED);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const qint64 from = chunks.at(c + i).first,
+                         to = chunks.at(c + i).second;
+            QVector<zs_match> *result = &matches[i];
+            result->clear();
+            pool.start(new FunctionRunnable([this, map, from, to, result]() {
+                scanSourceChunk(map + from, to - from, from, result);
+            }));
+        }
+        pool.waitForDone();
+
+        for (int i = 0; i < n; ++i) {
+            mergeSourceMatches(map, matches.at(i));
+        }
+
+        emitSeedProgress();
+        if (seedScanCanceled()) {
+            return -3;
+        }
+        if (n_BytesWritten >= n_TargetFileLength) {
+            return 0;
+        }
+    }
+
+    QByteArray tail = padSeedTail(map + tailStart, length - tailStart);
+    QVector<zs_match> tailMatches;
+    scanSourceChunk((const unsigned char*)tail.constData(), length - tailStart, 0, &tailMatches);
+    mergeSourceMatches((const unsigned char*)tail.constData(), tailMatches);
+    emitSeedProgress();
+    return 0;
+}
+
+/* Reads the seed through the file with submitSourceData, Used when the seed
+ * cannot be memory mapped. */
+qint32 ZsyncWriterPrivate::submitSourceStream(QFile *file) {
+    qint32 error = 0;
+    off_t in = 0;
+    /* Allocate buffer of 16 blocks */
+    qint32 bufsize = n_BlockSize * 16;
+    unsigned char *buf = (unsigned char*)malloc(bufsize + n_Context);
+    if (!buf)
+        return (error = -1);
+
+    p_TransferSpeed.reset(new QElapsedTimer);
+    p_TransferSpeed->start();
+    while (!file->atEnd()) {
         size_t len;
         off_t start_in = in;
 
@@ -1370,98 +2210,459 @@ qint32 ZsyncWriterPrivate::submitSourceFile(QFile *file) {
 
         /* Process the data in the buffer, and report progress */
         submitSourceData( buf, len, start_in);
-        {
-            qint64 bytesReceived = n_BytesWritten,
-                   bytesTotal = n_TargetFileLength;
-
-            int nPercentage = static_cast<int>(
-                                  (static_cast<float>
-                                   ( bytesReceived ) * 100.0
-                                  ) / static_cast<float>
-                                  (
-                                      bytesTotal
-                                  )
-                              );
-
-            double nSpeed =  bytesReceived * 1000.0 / p_TransferSpeed->elapsed();
-            QString sUnit;
-            if (nSpeed < 1024) {
-                sUnit = "bytes/sec";
-            } else if (nSpeed < 1024 * 1024) {
-                nSpeed /= 1024;
-                sUnit = "kB/s";
-            } else {
-                nSpeed /= 1024 * 1024;
-                sUnit = "MB/s";
+        emitSeedProgress();
+        if (seedScanCanceled()) {
+            error = -3;
+            break;
+        }
+    }
+    free(buf);
+    return error;
+}
+
+/* Same as submitSourceStream but the seed is read in large batches which
+ * are scanned like in submitMappedSourceParallel. Used when the seed cannot
+ * be memory mapped. */
+qint32 ZsyncWriterPrivate::submitSourceFileParallel(QFile *file) {
+    qint32 error = 0;
+    const int threads = n_ScanThreads;
+    const qint64 chunkSize = ((SEED_SCAN_CHUNK_SIZE + n_BlockSize - 1) / n_BlockSize) * n_BlockSize;
+    const qint64 batchSize = chunkSize * threads;
+
+    /* Room for the batch, the context which follows it and the zero padding at EOF. */
+    unsigned char *buf = (unsigned char*)malloc(batchSize + 2 * n_Context);
+    if (!buf)
+        return (error = -1);
+
+    INFO_START " submitSourceFileParallel : scanning seed with " LOGR threads LOGR " threads." INFO_END;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QVector<QVector<zs_match>> matches(threads);
+
+    p_TransferSpeed.reset(new QElapsedTimer);
+    p_TransferSpeed->start();
+
+    qint64 avail = file->read((char*)buf, batchSize + n_Context);
+    while (avail > 0) {
+        bool eof = file->atEnd();
+        /* No. of window positions we can consider in this batch. */
+        qint64 positions = eof ? avail : avail - n_Context;
+        if (eof) {          /* 0 pad to complete a block */
+            memset(buf + avail, 0, n_Context);
+        }
+
+        for (int i = 0; i < threads; ++i) {
+            qint64 from = i * chunkSize;
+            qint64 to = qMin(from + chunkSize, positions);
+            matches[i].clear();
+            if (from >= to) {
+                continue;
             }
+            QVector<zs_match> *result = &matches[i];
+            pool.start(new FunctionRunnable([this, buf, from, to, result]() {
+                scanSourceChunk(buf + from, to - from, from, result);
+            }));
+        }
+        pool.waitForDone();
 
-            emit progress(nPercentage, bytesReceived, bytesTotal, nSpeed, sUnit);
+        for (int i = 0; i < threads; ++i) {
+            mergeSourceMatches(buf, matches.at(i));
         }
-        QCoreApplication::processEvents();
-        if(b_CancelRequested == true) {
+
+        emitSeedProgress();
+        if (seedScanCanceled()) {
             error = -3;
-            b_CancelRequested = false;
-            emit canceled();
             break;
         }
+
+        if (eof || n_BytesWritten >= n_TargetFileLength) {
+            break;
+        }
+
+        /* Move the context of the next batch to the start and refill. */
+        memmove(buf, buf + positions, n_Context);
+        avail = n_Context + file->read((char*)(buf + n_Context), batchSize);
     }
-    p_TransferSpeed.reset(new QElapsedTimer);
-    file->close();
     free(buf);
     return error;
 }
 
+/* Returns a copy of the last bytes of a seed followed by n_Context zero
+ * bytes, Which completes the last block of the seed. */
+QByteArray ZsyncWriterPrivate::padSeedTail(const unsigned char *tail, qint64 length) {
+    QByteArray padded((const char*)tail, (int)length);
+    padded.append(QByteArray(n_Context, '\0'));
+    return padded;
+}
+
+/* Checks if a cancel was requested during a seed scan, The canceled signal
+ * is emitted by handleSeedScanFinished once the scan has stopped. */
+bool ZsyncWriterPrivate::seedScanCanceled() {
+    if(isCancelRequested()) {
+        return true;
+    }
+    return false;
+}
+
+/* Scans the window positions [0, len) of the given data for blocks of the
+ * target file, The data must have n_Context readable bytes after len.
+ * Found runs are appended to matches with offsets relative to the data plus
+ * base.
+ *
+ * This is the same algorithm as submitSourceData but it does not touch
+ * anything other than its arguments, so it is safe to run many of these at
+ * once as long as nobody modifies the hash tables.
+ */
+void ZsyncWriterPrivate::scanSourceChunk(const unsigned char *data, qint64 len, qint64 base, QVector<zs_match> *matches) const {
+    const qint32 bs = n_BlockSize;
+    zs_blockid nextMatch = -1;
+    rsum r[2] = { { 0, 0 }, { 0, 0 } };
+    qint64 x = 0;
+    qint64 falseHits = 0;
+
+    r[0] = calc_rsum_block(data, bs);
+    if (n_SeqMatches > 1)
+        r[1] = calc_rsum_block(data + bs, bs);
+
+    while (x < len) {
+        qint32 blocks_matched = 0;
+        unsigned char md4sum[2][CHECKSUM_SIZE];
+
+        /* If the previous block was a match, test this block against the
+         * block in the target immediately after our previous hit. */
+        if (nextMatch >= 0 && n_SeqMatches > 1) {
+            zs_blockid id = nextMatch;
+            if (p_BlockRsums[id].a == (r[0].a & p_WeakCheckSumMask) && p_BlockRsums[id].b == r[0].b) {
+                md4_digest(data + x, bs, &md4sum[0][0]);
+                if (!memcmp(&md4sum[0], blockCheckSum(id), n_StrongCheckSumBytes)) {
+                    matches->append({ base + x, id, 1 });
+                    nextMatch = (id + 1 < n_Blocks) ? id + 1 : -1;
+                    blocks_matched = 1;
+                }
+            }
+            if (!blocks_matched) {
+                nextMatch = -1;
+            }
+        }
+
+        if (!blocks_matched) {
+            quint64 hash = seed_filter_hash(rsum_key(r[0], p_WeakCheckSumMask),
+                                            (n_SeqMatches > 1) ? rsum_key(r[1], p_WeakCheckSumMask) : 0);
+            if (seedFilterContains(hash)) {
+                qint32 done_md4 = -1;
+                bool weakHit = false;
+                const quint32 key = rsum_key(r[0], p_WeakCheckSumMask);
+                for (quint32 slot = hashSlot(key);
+                        p_RsumHash[slot].id != HASH_SLOT_EMPTY;
+                        slot = (slot + 1) & p_HashMask) {
+                    const zs_blockid id = p_RsumHash[slot].id;
+                    if (id < 0 || rsum_key(p_BlockRsums[id], p_WeakCheckSumMask) != key) {
+                        continue;
+                    }
+                    if (n_SeqMatches > 1
+                            && (p_BlockRsums[id + 1].a != (r[1].a & p_WeakCheckSumMask)
+                                || p_BlockRsums[id + 1].b != r[1].b)) {
+                        continue;
+                    }
+
+                    weakHit = true;
+                    bool ok = true;
+                    for (qint32 check_md4 = 0; ok && check_md4 < n_SeqMatches; ++check_md4) {
+                        if (check_md4 > done_md4) {
+                            md4_digest(data + x + bs * check_md4, bs, &md4sum[check_md4][0]);
+                            done_md4 = check_md4;
+                        }
+                        ok = !memcmp(&md4sum[check_md4],
+                                     blockCheckSum(id + check_md4),
+                                     n_StrongCheckSumBytes);
+                    }
+
+                    if (ok) {
+                        matches->append({ base + x, id, qMin(n_SeqMatches, n_Blocks - id) });
+                        nextMatch = (id + n_SeqMatches < n_Blocks) ? id + n_SeqMatches : -1;
+                        blocks_matched = n_SeqMatches;
+                    }
+                }
+                if (!weakHit) {
+                    falseHits++;
+                }
+            }
+        }
+
+        /* Skip forward on a hit, see submitSourceData. */
+        if (blocks_matched) {
+            x += bs * blocks_matched;
+            if (x >= len) {
+                break;
+            }
+            if (n_SeqMatches > 1 && blocks_matched == 1)
+                r[0] = r[1];
+            else
+                r[0] = calc_rsum_block(data + x, bs);
+            if (n_SeqMatches > 1)
+                r[1] = calc_rsum_block(data + x + bs, bs);
+            continue;
+        }
+
+        /* Else - advance the window to the next candidate position. */
+        if (x + 1 >= len) {
+            break;
+        }
+        x += rollToCandidate(data + x, len - 1 - x, r);
+    }
+    n_SeedFilterFalseHits.fetchAndAddRelaxed(falseHits);
+}
+
+/* Rolls the weak checksums r of the window at data forward by at most n
+ * positions, stopping at the first window which may be in p_SeedFilter.
+ * Returns the no. of positions rolled, r is left with the weak checksums of
+ * the window at that position.
+ *
+ * The rsums are computed in batches by the vectorized kernel so the per
+ * byte work is only the p_SeedFilter probe. */
+qint64 ZsyncWriterPrivate::rollToCandidate(const unsigned char *data, qint64 n, rsum *r) const {
+    return (this->*p_RollToCandidate)(data, n, r);
+}
+
+/* rollToCandidate with the no. of sequential matches and the weak checksum
+ * mask known at compile time, So the probe loop has no branches on the
+ * configuration and the key for a single match skips the second window. */
+template <qint32 SeqMatches, unsigned short WeakCheckSumMask>
+qint64 ZsyncWriterPrivate::rollToCandidateFor(const unsigned char *data, qint64 n, rsum *r) const {
+    unsigned short a[SeqMatches][RSUM_ROLL_BATCH],
+             b[SeqMatches][RSUM_ROLL_BATCH];
+    qint64 rolled = 0;
+    bool found = false;
+
+    while (!found && rolled < n) {
+        qint32 count = (qint32)qMin<qint64>(RSUM_ROLL_BATCH, n - rolled);
+        p_RsumRoll(data + rolled, n_BlockSize, n_BlockShift, r[0], count, a[0], b[0]);
+        if (SeqMatches > 1)
+            p_RsumRoll(data + rolled + n_BlockSize, n_BlockSize, n_BlockShift, r[1], count,
+                       a[SeqMatches - 1], b[SeqMatches - 1]);
+
+        for (qint32 k = 0; k < count; ++k) {
+            quint64 hash = seed_filter_hash(((quint32)(a[0][k] & WeakCheckSumMask) << 16) | b[0][k],
+                                            (SeqMatches > 1) ?
+                                            ((quint32)(a[SeqMatches - 1][k] & WeakCheckSumMask) << 16) | b[SeqMatches - 1][k] : 0);
+            if (seedFilterContains(hash)) {
+                count = k + 1;
+                found = true;
+                break;
+            }
+        }
+
+        r[0].a = a[0][count - 1];
+        r[0].b = b[0][count - 1];
+        if (SeqMatches > 1) {
+            r[1].a = a[SeqMatches - 1][count - 1];
+            r[1].b = b[SeqMatches - 1][count - 1];
+        }
+        rolled += count;
+    }
+    n_SeedFilterProbes.fetchAndAddRelaxed(rolled);
+    return rolled;
+}
+
+/* rollToCandidate for any configuration, The no. of sequential matches and
+ * the weak checksum mask are read for every window and the rsums are rolled
+ * with the lazily dispatched rsum_roll. The specializations are timed
+ * against it by the seed scan benchmark. */
+qint64 ZsyncWriterPrivate::rollToCandidateGeneric(const unsigned char *data, qint64 n, rsum *r) const {
+    unsigned short a[2][RSUM_ROLL_BATCH],
+             b[2][RSUM_ROLL_BATCH];
+    qint64 rolled = 0;
+    bool found = false;
+
+    while (!found && rolled < n) {
+        qint32 count = (qint32)qMin<qint64>(RSUM_ROLL_BATCH, n - rolled);
+        rsum_roll(data + rolled, n_BlockSize, n_BlockShift, r[0], count, a[0], b[0]);
+        if (n_SeqMatches > 1)
+            rsum_roll(data + rolled + n_BlockSize, n_BlockSize, n_BlockShift, r[1], count, a[1], b[1]);
+
+        for (qint32 k = 0; k < count; ++k) {
+            quint64 hash = seed_filter_hash(rsum_key({ a[0][k], b[0][k] }, p_WeakCheckSumMask),
+                                            (n_SeqMatches > 1) ? rsum_key({ a[1][k], b[1][k] }, p_WeakCheckSumMask) : 0);
+            if (seedFilterContains(hash)) {
+                count = k + 1;
+                found = true;
+                break;
+            }
+        }
+
+        r[0].a = a[0][count - 1];
+        r[0].b = b[0][count - 1];
+        if (n_SeqMatches > 1) {
+            r[1].a = a[1][count - 1];
+            r[1].b = b[1][count - 1];
+        }
+        rolled += count;
+    }
+    n_SeedFilterProbes.fetchAndAddRelaxed(rolled);
+    return rolled;
+}
+
+/* Picks the rollToCandidate and rsum_roll specializations for the current
+ * configuration, zsync only ever needs 1 or 2 sequential matches and a weak
+ * checksum of 2 to 4 bytes. */
+void ZsyncWriterPrivate::selectRollKernels() {
+    p_RsumRoll = rsum_roll_kernel_for(n_BlockShift);
+    if (n_SeqMatches > 1) {
+        p_RollToCandidate = p_WeakCheckSumMask == 0xffff ? &ZsyncWriterPrivate::rollToCandidateFor<2, 0xffff> :
+                            p_WeakCheckSumMask == 0xff ? &ZsyncWriterPrivate::rollToCandidateFor<2, 0xff> :
+                            &ZsyncWriterPrivate::rollToCandidateFor<2, 0>;
+    } else {
+        p_RollToCandidate = p_WeakCheckSumMask == 0xffff ? &ZsyncWriterPrivate::rollToCandidateFor<1, 0xffff> :
+                            p_WeakCheckSumMask == 0xff ? &ZsyncWriterPrivate::rollToCandidateFor<1, 0xff> :
+                            &ZsyncWriterPrivate::rollToCandidateFor<1, 0>;
+    }
+}
+
+/* Checks if the window with the given seed filter hash may be a block
+ * of the target file, false means it is surely not. */
+bool ZsyncWriterPrivate::seedFilterContains(quint64 hash) const {
+    const quint64 *block = p_SeedFilter + ((quint64)((hash >> 32) & n_SeedFilterMask) << 3);
+    for (qint32 i = 0; i < SEED_FILTER_PROBES; ++i) {
+        quint32 bit = (hash >> (9 * i)) & 511;
+        if (!(block[bit >> 6] & (1ull << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Adds the given seed filter hash to the seed filter. */
+void ZsyncWriterPrivate::seedFilterInsert(quint64 hash) {
+    quint64 *block = p_SeedFilter + ((quint64)((hash >> 32) & n_SeedFilterMask) << 3);
+    for (qint32 i = 0; i < SEED_FILTER_PROBES; ++i) {
+        quint32 bit = (hash >> (9 * i)) & 511;
+        block[bit >> 6] |= 1ull << (bit & 63);
+    }
+}
+
+/* Writes the blocks found by scanSourceChunk that we don't know yet,
+ * data must be the buffer the match offsets refer to.
+ * Returns the number of blocks written. */
+qint32 ZsyncWriterPrivate::mergeSourceMatches(const unsigned char *data, const QVector<zs_match> &matches) {
+    qint32 got_blocks = 0;
+    for (auto iter = matches.constBegin(),
+            end = matches.constEnd();
+            iter != end;
+            ++iter) {
+        const unsigned char *blocks = data + (*iter).offset;
+        qint32 k = 0;
+        while (k < (*iter).blocks) {
+            /* Skip what we have and write the following run of unknown blocks. */
+            while (k < (*iter).blocks && alreadyGotBlock((*iter).id + k)) {
+                ++k;
+            }
+            qint32 from = k;
+            while (k < (*iter).blocks && !alreadyGotBlock((*iter).id + k)) {
+                ++k;
+            }
+            if (k > from) {
+                writeBlocks(blocks + ((qint64)from * n_BlockSize), (*iter).id + from, (*iter).id + k - 1);
+                got_blocks += k - from;
+            }
+        }
+    }
+    compactHash();
+    return got_blocks;
+}
+
+/* Emits the progress of the seed scan in terms of bytes written to the
+ * target file. */
+void ZsyncWriterPrivate::emitSeedProgress() {
+    qint64 bytesReceived = n_BytesWritten,
+           bytesTotal = n_TargetFileLength;
+
+    int nPercentage = static_cast<int>(
+                          (static_cast<float>
+                           ( bytesReceived ) * 100.0
+                          ) / static_cast<float>
+                          (
+                              bytesTotal
+                          )
+                      );
+
+    double nSpeed =  bytesReceived * 1000.0 / p_TransferSpeed->elapsed();
+    QString sUnit;
+    if (nSpeed < 1024) {
+        sUnit = "bytes/sec";
+    } else if (nSpeed < 1024 * 1024) {
+        nSpeed /= 1024;
+        sUnit = "kB/s";
+    } else {
+        nSpeed /= 1024 * 1024;
+        sUnit = "MB/s";
+    }
+
+    emit progress(nPercentage, bytesReceived, bytesTotal, nSpeed, sUnit);
+}
+
 
 
 /* Build hash tables to quickly lookup a block based on its rsum value.
  * Returns non-zero if successful.
  */
 qint32 ZsyncWriterPrivate::buildHash() {
-    zs_blockid id;
-    qint32 i = 16;
+    qint32 i = 4;
 
-    /* Try hash size of 2^i; step down the value of i until we find a good size
-     */
-    while ((2 << (i - 1)) > n_Blocks && i > 4) {
-        i--;
-        QCoreApplication::processEvents();
+    /* Size the table to 2^i slots, At least twice the no. of blocks so
+     * that the probe runs stay short. */
+    while (i < 31 && (qint64(1) << i) < qint64(n_Blocks) * 2) {
+        i++;
     }
 
     /* Allocate hash based on rsum */
-    p_HashMask = (2 << i) - 1;
-    p_RsumHash = (hash_entry**)calloc(p_HashMask + 1, sizeof *(p_RsumHash));
+    p_HashMask = (quint32)((qint64(1) << i) - 1);
+    n_HashShift = 32 - i;
+    p_RsumHash = (zs_hash_slot*)malloc((qint64(p_HashMask) + 1) * sizeof *(p_RsumHash));
     if (!p_RsumHash)
         return 0;
+    for (quint32 slot = 0; slot <= p_HashMask; ++slot) {
+        p_RsumHash[slot].id = HASH_SLOT_EMPTY;
+    }
 
-    /* Allocate bit-table based on rsum */
-    p_BitHashMask = (2 << (i + BITHASHBITS)) - 1;
-    p_BitHash = (unsigned char*)calloc(p_BitHashMask + 1, 1);
-    if (!p_BitHash) {
+    /* Allocate the seed filter, SEED_FILTER_BITS_PER_BLOCK bits per block
+     * in 512 bit filter blocks, Rounded up to a power of two no. of blocks. */
+    qint64 filterBlocks = 1;
+    while (filterBlocks < 0x100000000ll
+            && filterBlocks * 512 < qint64(n_Blocks) * SEED_FILTER_BITS_PER_BLOCK) {
+        filterBlocks <<= 1;
+    }
+    n_SeedFilterMask = (quint32)(filterBlocks - 1);
+    p_SeedFilter = nullptr;
+    if (posix_memalign((void**)&p_SeedFilter, 64, filterBlocks * 64) != 0) {
+        p_SeedFilter = NULL;
         free(p_RsumHash);
         p_RsumHash = NULL;
         return 0;
     }
+    memset(p_SeedFilter, 0, filterBlocks * 64);
+    n_SeedFilterProbes.store(0);
+    n_SeedFilterFalseHits.store(0);
 
     /* Now fill in the hash tables.
-     * Minor point: We do this in reverse order, because we're adding entries
-     * to the hash chains by prepending, so if we iterate over the data in
-     * reverse then the resulting hash chains have the blocks in normal order.
-     * That's improves our pattern of I/O when writing out identical blocks
-     * once we are processing data; we will write them in order. */
-    for (id = n_Blocks; id > 0;) {
-        /* Decrement the loop variable here, and get the hash entry. */
-        hash_entry *e = p_BlockHashes + (--id);
-
-        /* Prepend to linked list for this hash entry */
-        unsigned h = calcRHash( e);
-        e->next = p_RsumHash[h & p_HashMask];
-        p_RsumHash[h & p_HashMask] = e;
-
-        /* And set relevant bit in the p_BitHash to 1 */
-        p_BitHash[(h & p_BitHashMask) >> 3] |= 1 << (h & 7);
-
-        QCoreApplication::processEvents();
+     * Minor point: We do this in block order, because linear probing keeps
+     * the insertion order for the slots with the same key, So identical
+     * blocks are found and written out in order. */
+    for (zs_blockid id = 0; id < n_Blocks; ++id) {
+        insertBlockIntoHash(id);
     }
+    n_HashEntries = n_Blocks;
+    n_HashRemoved = 0;
+
+    selectRollKernels();
+
+    INFO_START " buildHash : using " LOGR rsum_roll_kernel_name() LOGR " rolling checksum kernel." INFO_END;
+    INFO_START " buildHash : using " LOGR md4_digest_many_kernel_name() LOGR " md4 kernel." INFO_END;
+    INFO_START " buildHash : block tables of " LOGR
+    qint64(n_Blocks) * (qint64)(sizeof(rsum) + n_StrongCheckSumBytes) + (qint64(p_HashMask) + 1) * (qint64)sizeof(zs_hash_slot)
+    LOGR " bytes." INFO_END;
+    INFO_START " buildHash : seed filter of " LOGR filterBlocks * 64 LOGR " bytes, "
+    LOGR SEED_FILTER_PROBES LOGR " probes." INFO_END;
     return 1;
 }
 
@@ -1469,103 +2670,74 @@ qint32 ZsyncWriterPrivate::buildHash() {
  * returned in a hash lookup again (e.g. because we now have the data)
  */
 void ZsyncWriterPrivate::removeBlockFromHash(zs_blockid id) {
-    hash_entry *t = &(p_BlockHashes[id]);
-
-    hash_entry **p = &(p_RsumHash[calcRHash(t) & p_HashMask]);
-
-    while (*p != NULL) {
-        if (*p == t) {
-            if (t == p_Rover) {
-                p_Rover = t->next;
-            }
-            *p = (*p)->next;
+    const quint32 key = rsum_key(p_BlockRsums[id], p_WeakCheckSumMask);
+
+    /* Leave a marker instead of emptying the slot so that the probe runs
+     * through this slot stay intact. */
+    for (quint32 slot = hashSlot(key);
+            p_RsumHash[slot].id != HASH_SLOT_EMPTY;
+            slot = (slot + 1) & p_HashMask) {
+        if (p_RsumHash[slot].id == id) {
+            p_RsumHash[slot].id = HASH_SLOT_REMOVED;
+            ++n_HashRemoved;
             return;
-        } else {
-            p = &((*p)->next);
         }
-        QCoreApplication::processEvents();
     }
 }
 
+/* Adds the given block to the rsum hash table and the seed filter. */
+void ZsyncWriterPrivate::insertBlockIntoHash(zs_blockid id) {
+    quint32 key = rsum_key(p_BlockRsums[id], p_WeakCheckSumMask);
+    quint32 slot = hashSlot(key);
+    while (p_RsumHash[slot].id != HASH_SLOT_EMPTY) {
+        slot = (slot + 1) & p_HashMask;
+    }
+    p_RsumHash[slot].id = id;
 
-/* This determines which of the existing known ranges x falls in.
- * It returns -1 if it is inside an existing range (it doesn't tell you which
- *  one; if you already have it, that usually is enough to know).
- * Or it returns 0 if x is before the 1st range;
- * 1 if it is between ranges 1 and 2 (array indexes 0 and 1)
- * ...
- * n_Ranges if it is after the last range
- */
-qint32 ZsyncWriterPrivate::rangeBeforeBlock(zs_blockid x) {
-    /* Lowest number and highest number block that it could be inside (0 based) */
-    qint32 min = 0, max = n_Ranges-1;
+    /* And add the block to the seed filter */
+    seedFilterInsert(calcFilterHash(id));
+}
 
-    /* By bisection */
-    for (; min<=max;) {
-        /* Range number to compare against */
-        qint32 r = (max+min)/2;
+/* Rebuilds the rsum hash table and the seed filter without the removed
+ * blocks once they are at least half of the table, Else lookups have to
+ * step over more and more markers and the filter lets through the windows
+ * of blocks we already have.
+ * Must not be called while a hash chain is walked, So it is called between
+ * the windows of a scan and not from removeBlockFromHash. */
+void ZsyncWriterPrivate::compactHash() {
+    if (n_HashRemoved < HASH_COMPACT_MIN || n_HashRemoved * 2 < n_HashEntries) {
+        return;
+    }
 
-        if (x > p_Ranges[2*r+1]) min = r+1;  /* After range r */
-        else if (x < p_Ranges[2*r]) max = r-1;/* Before range r */
-        else return -1;                     /* In range r */
+    QVector<zs_blockid> ids;
+    ids.reserve(n_HashEntries - n_HashRemoved);
+    for (quint32 slot = 0; slot <= p_HashMask; ++slot) {
+        if (p_RsumHash[slot].id >= 0) {
+            ids.append(p_RsumHash[slot].id);
+        }
+        p_RsumHash[slot].id = HASH_SLOT_EMPTY;
     }
+    memset(p_SeedFilter, 0, (qint64(n_SeedFilterMask) + 1) * 64);
 
-    /* If we reach here, we know min = max + 1 and we were below range max+1
-     * and above range min-1.
-     * So we're between range max and max + 1
-     * So we return max + 1  (return value is 1 based)  ( = min )
-     */
-    return min;
+    /* In block order, See buildHash. */
+    std::sort(ids.begin(), ids.end());
+    for (auto iter = ids.constBegin(); iter != ids.constEnd(); ++iter) {
+        insertBlockIntoHash(*iter);
+    }
+    n_HashEntries = ids.size();
+    n_HashRemoved = 0;
 }
 
+
 /* Mark the given blockid as known, updating the stored known ranges
  * appropriately */
 void ZsyncWriterPrivate::addToRanges(zs_blockid x) {
-    qint32 r = rangeBeforeBlock(x);
-
-    if (r == -1) {
-        /* Already have this block */
-    } else {
-        /* If between two ranges and exactly filling the hole between them,
-         * merge them */
-        if (r > 0 && r < n_Ranges
-                && p_Ranges[2 * (r - 1) + 1] == x - 1
-                && p_Ranges[2 * r] == x + 1) {
-
-            // This block fills the gap between two areas that we have got completely. Merge the adjacent ranges
-            p_Ranges[2 * (r - 1) + 1] = p_Ranges[2 * r + 1];
-            memmove(&p_Ranges[2 * r], &p_Ranges[2 * r + 2],
-                    (n_Ranges - r - 1) * sizeof(p_Ranges[0]) * 2);
-            n_Ranges--;
-        }
-
-        /* If adjoining a range below, add to it */
-        else if (r > 0 && n_Ranges && p_Ranges[2 * (r - 1) + 1] == x - 1) {
-            p_Ranges[2 * (r - 1) + 1] = x;
-        }
-
-        /* If adjoining a range above, add to it */
-        else if (r < n_Ranges && p_Ranges[2 * r] == x + 1) {
-            p_Ranges[2 * r] = x;
-        }
-
-        else { /* New range for this block alone */
-            void *guard = realloc(p_Ranges, (n_Ranges + 1) * 2 * sizeof(p_Ranges[0]));
-            if(!guard) {
-                return;
-            }
-            p_Ranges = (zs_blockid*) guard;
-            memmove(&p_Ranges[2 * r + 2], &p_Ranges[2 * r],
-                    (n_Ranges - r) * 2 * sizeof(p_Ranges[0]));
-            p_Ranges[2 * r] = p_Ranges[2 * r + 1] = x;
-            n_Ranges++;
-        }
-    }
+    m_KnownBlocks.add(x);
 }
 
 /* Return true if blockid x of the target file is already known */
 qint32 ZsyncWriterPrivate::alreadyGotBlock(zs_blockid x) {
-    return (rangeBeforeBlock(x) == -1);
+    return m_KnownBlocks.contains(x);
 }
 
 /* Returns the blockid of the next block which we already have data for.
@@ -1575,34 +2747,30 @@ qint32 ZsyncWriterPrivate::alreadyGotBlock(zs_blockid x) {
  * the end of the file).
  */
 zs_blockid ZsyncWriterPrivate::nextKnownBlock(zs_blockid x) {
-    qint32 r = rangeBeforeBlock(x);
-    if (r == -1)
-        return x;
-    if (r == n_Ranges) {
-        return n_Blocks;
-    }
-    /* Else return first block of next known range. */
-    return p_Ranges[2*r];
+    return m_KnownBlocks.nextKnown(x, n_Blocks);
 }
 
-/* Calculates the rsum hash table hash for the given hash entry. */
-unsigned ZsyncWriterPrivate::calcRHash(const hash_entry *const e) {
-    unsigned h = e[0].r.b;
-
-    h ^= ((n_SeqMatches > 1) ? e[1].r.b
-          : e[0].r.a & p_WeakCheckSumMask) << BITHASHBITS;
+/* Calculates the seed filter hash for the given block. */
+quint64 ZsyncWriterPrivate::calcFilterHash(zs_blockid id) const {
+    return seed_filter_hash(rsum_key(p_BlockRsums[id], p_WeakCheckSumMask),
+                            (n_SeqMatches > 1) ? rsum_key(p_BlockRsums[id + 1], p_WeakCheckSumMask) : 0);
+}
 
-    return h;
+/* The strong checksum of the given block, n_StrongCheckSumBytes long. */
+unsigned char *ZsyncWriterPrivate::blockCheckSum(zs_blockid id) const {
+    return p_BlockCheckSums + (qint64)id * n_StrongCheckSumBytes;
 }
 
-/* Returns the hash entry's blockid. */
-zs_blockid ZsyncWriterPrivate::getHashEntryBlockId(const hash_entry *e) {
-    return e - p_BlockHashes;
+/* Returns the home slot of the given key in the rsum hash table. */
+quint32 ZsyncWriterPrivate::hashSlot(quint32 key) const {
+    /* Fibonacci hashing, The top bits of the product are the best mixed. */
+    return (quint32)((key * 2654435761u) >> n_HashShift) & p_HashMask;
 }
 
 
 /* Writes the block range (inclusive) from the supplied buffer to the given
- * under-construction output file */
+ * under-construction output file, The data is copied and written by
+ * p_BlockWriter on its own thread. */
 void ZsyncWriterPrivate::writeBlocks(const unsigned char *data, zs_blockid bfrom, zs_blockid bto) {
     if(!p_TargetFile->isOpen() || !p_TargetFile->autoRemove())
         return;
@@ -1615,14 +2783,49 @@ void ZsyncWriterPrivate::writeBlocks(const unsigned char *data, zs_blockid bfrom
     //     = <original bto> - bfrom
     //     = actual no. of blocks got.
 
-    off_t len = ((off_t) (bto - bfrom + 1)) << n_BlockShift;
-    off_t offset = ((off_t)bfrom) << n_BlockShift;
+    qint64 len = ((qint64) (bto - bfrom + 1)) << n_BlockShift;
+    qint64 offset = ((qint64)bfrom) << n_BlockShift;
+
+    p_BlockWriter->write(offset, data, len);
+    n_BytesWritten += len;
+    markBlocksWritten(bfrom, bto);
+}
+
+/* Same as writeBlocks but the blocks are at the start of a downloaded
+ * buffer which is shared with p_BlockWriter instead of copied. Blocks
+ * we already have are skipped, A merged range may cover some. */
+void ZsyncWriterPrivate::writeDownloadedBlocks(const QByteArray &data, zs_blockid bfrom, zs_blockid bto) {
+    if(!p_TargetFile->isOpen() || !p_TargetFile->autoRemove())
+        return;
 
-    auto pos = p_TargetFile->pos();
-    p_TargetFile->seek(offset);
-    n_BytesWritten += p_TargetFile->write((char*)data, len);
-    p_TargetFile->seek(pos);
+    /* Collect first, Marking the blocks changes m_KnownBlocks. */
+    QVector<QPair<zs_blockid, zs_blockid>> unknown;
+    m_KnownBlocks.forEachGap(bfrom, bto + 1, [&unknown](zs_blockid from, zs_blockid to) {
+        unknown.append(qMakePair(from, to));
+    });
 
+    for (auto iter = unknown.constBegin(); iter != unknown.constEnd(); ++iter) {
+        qint64 len = ((qint64) ((*iter).second - (*iter).first)) << n_BlockShift;
+        qint64 offset = ((qint64)(*iter).first) << n_BlockShift;
+
+        p_BlockWriter->write(offset, data, ((qint64)((*iter).first - bfrom)) << n_BlockShift, len);
+        n_BytesWritten += len;
+        markBlocksWritten((*iter).first, (*iter).second - 1);
+    }
+}
+
+/* Returns the no. of blocks in the half open range [from, to) we don't
+ * have yet. */
+qint32 ZsyncWriterPrivate::countUnknownBlocks(zs_blockid from, zs_blockid to) const {
+    qint32 n = 0;
+    m_KnownBlocks.forEachGap(from, qMin(to, n_Blocks), [&n](zs_blockid gapFrom, zs_blockid gapTo) {
+        n += gapTo - gapFrom;
+    });
+    return n;
+}
+
+/* Book keeping after the blocks [bfrom, bto] are handed to p_BlockWriter. */
+void ZsyncWriterPrivate::markBlocksWritten(zs_blockid bfrom, zs_blockid bto) {
     {
         /* Having written those blocks, discard them from the rsum hashes (as
          * we don't need to identify data for those blocks again, and this may
@@ -1632,18 +2835,106 @@ void ZsyncWriterPrivate::writeBlocks(const unsigned char *data, zs_blockid bfrom
         int id;
         for (id = bfrom; id <= bto; id++) {
             removeBlockFromHash(id);
-            addToRanges(id);
-            QCoreApplication::processEvents();
         }
+        m_KnownBlocks.add(bfrom, bto);
     }
     return;
 }
 
-/* Calculates the Md4 Checksum of the given data with respect to the given len. */
-void ZsyncWriterPrivate::calcMd4Checksum(unsigned char *c, const unsigned char *data, size_t len) {
-    p_Md4Ctx->reset();
-    p_Md4Ctx->addData((const char*)data, len);
-    auto result = p_Md4Ctx->result();
-    memmove(c, result.constData(), sizeof(const char) * result.size());
-    return;
+/*
+ * Runs on the compute thread, Copies the blocks which an interrupted update
+ * recorded in the journal of the given .part file to the target file. Only
+ * the journaled ranges are read, The file is not scanned.
+ * Returns 1 if the file was adopted, 0 if it has no usable journal or is
+ * shorter than its journal and has to be scanned like any other seed, -2
+ * if the hash table cannot be built and -3 if canceled.
+*/
+qint32 ZsyncWriterPrivate::adoptJournaledFile(const QString &path) {
+    ZsyncBlockRanges journaled;
+    ZsyncJournal journal(s_TargetFileSHA1, n_TargetFileLength, n_BlockSize, n_Blocks);
+    if(!journal.load(ZsyncJournal::pathOf(path), &journaled) || journaled.isEmpty()) {
+        return 0;
+    }
+
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    /* markBlocksWritten needs the hash table. */
+    if (!p_RsumHash) {
+        if (!buildHash()) {
+            return -2;
+        }
+    }
+
+    INFO_START " adoptJournaledFile : adopting " LOGR journaled.count() LOGR " known block ranges from " LOGR path LOGR "." INFO_END;
+
+    /* Only copy the blocks we do not have yet. */
+    QVector<QPair<zs_blockid, zs_blockid>> ranges;
+    journaled.forEachRange([&](zs_blockid first, zs_blockid last) {
+        m_KnownBlocks.forEachGap(first, last + 1, [&](zs_blockid from, zs_blockid to) {
+            ranges.append(qMakePair(from, to));
+        });
+    });
+
+    const zs_blockid chunkBlocks = (zs_blockid)qMax<qint64>(1, SEED_SCAN_CHUNK_SIZE >> n_BlockShift);
+    QByteArray buffer;
+    for(auto iter = ranges.constBegin(); iter != ranges.constEnd(); ++iter) {
+        for(zs_blockid from = (*iter).first; from < (*iter).second; from += chunkBlocks) {
+            if(isCancelRequested()) {
+                return -3;
+            }
+
+            zs_blockid to = qMin(from + chunkBlocks, (*iter).second);
+            qint64 offset = ((qint64)from) << n_BlockShift,
+                   length = ((qint64)(to - from)) << n_BlockShift;
+            buffer.resize(length);
+            qint64 got = file.seek(offset) ? file.read(buffer.data(), length) : -1;
+
+            /* Only the padding of the last block may be missing from the file,
+             * Else the blocks copied so far are kept and the rest of the
+             * file is found by the rolling scan. */
+            if(got < length && (got < 0 || offset + got < n_TargetFileLength)) {
+                WARNING_START " adoptJournaledFile : " LOGR path LOGR " is shorter than its journal, scanning it." WARNING_END;
+                return 0;
+            }
+            if(got < length) {
+                memset(buffer.data() + got, 0, length - got);
+            }
+            writeBlocks((const unsigned char*)buffer.constData(), from, to - 1);
+        }
+        emitSeedProgress();
+    }
+    return 1;
+}
+
+/*
+ * Saves the known blocks to the journal of the temporary target file, The
+ * written data is synced first so the journal never claims blocks which
+ * are not on the disk.
+*/
+void ZsyncWriterPrivate::saveJournal() {
+    m_JournalTimer.restart();
+    if(!p_TargetFile || !p_TargetFile->isOpen() || !p_TargetFile->autoRemove() || !p_BlockWriter) {
+        return;
+    }
+
+    if(!p_BlockWriter->flush() || fdatasync(p_TargetFile->handle()) != 0) {
+        WARNING_START " saveJournal : cannot sync the temporary target file." WARNING_END;
+        return;
+    }
+
+    ZsyncJournal journal(s_TargetFileSHA1, n_TargetFileLength, n_BlockSize, n_Blocks);
+    if(!journal.save(ZsyncJournal::pathOf(p_TargetFile->fileName()), m_KnownBlocks)) {
+        WARNING_START " saveJournal : cannot save the journal." WARNING_END;
+    }
+}
+
+/* Removes the journal of the temporary target file, If any. */
+void ZsyncWriterPrivate::removeJournal() {
+    if(!p_TargetFile || !p_TargetFile->autoRemove()) {
+        return;
+    }
+    QFile::remove(ZsyncJournal::pathOf(p_TargetFile->fileName()));
 }
@@ -12,8 +12,15 @@
 #include <QtConcurrent>
 #include <QFuture>
 #include <QEventLoop>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QNetworkAccessManager>
 
 #include "SimpleDownload.hpp"
+#include "RangeServer.hpp"
+#include "zsyncwriter_p.hpp"
+#include "zsyncremotecontrolfileparser_p.hpp"
+#include "zsyncjournal_p.hpp"
 
 class QAppImageUpdateTests : public QObject {
     Q_OBJECT
@@ -591,6 +598,367 @@ class QAppImageUpdateTests : public QObject {
         QVERIFY(action == QAppImageUpdate::Action::Update);
     }
 
+    // Scan a seed of a little over SEED_SCAN_CHUNK_SIZE on one thread.
+    // A target block sits in the seed just before the end of the first
+    // chunk, So the skip after its match runs past the few window
+    // positions of the second chunk. The scan has to carry the skip on
+    // to the tail instead of spinning on the second chunk.
+    void zsyncWriterSerialScanShortChunk() {
+        const qint32 blockSize = 4096;
+        const qint64 seedLength = SEED_SCAN_CHUNK_SIZE + 100 + blockSize;
+        const qint64 blockAt = SEED_SCAN_CHUNK_SIZE - 2000; // not block aligned.
+        const qint64 targetLength = 2 * blockSize;
+
+        auto seedByte = [](qint64 at) {
+            return static_cast<char>((static_cast<quint64>(at) * 2654435761u) >> 24);
+        };
+        /// The first block is in the seed, The second one is not.
+        RangeServer::Reader reader = [=](qint64 offset, char *out, qint64 length) {
+            for(qint64 i = 0; i < length; ++i) {
+                qint64 at = offset + i;
+                out[i] = (at < blockSize) ? seedByte(blockAt + at) : static_cast<char>(seedByte(at * 7) ^ 0x5a);
+            }
+        };
+
+        QString seedPath = m_TempDir->path() + "/SerialScanSeed.AppImage";
+        {
+            QByteArray seed(static_cast<int>(seedLength), '\0');
+            for(qint64 i = 0; i < seedLength; ++i) {
+                seed[static_cast<int>(i)] = seedByte(i);
+            }
+            QFile file(seedPath);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            QCOMPARE(file.write(seed), seedLength);
+            file.close();
+        }
+
+        QByteArray target(static_cast<int>(targetLength), '\0');
+        reader(0, target.data(), targetLength);
+        QString targetSha1 = QString(QCryptographicHash::hash(target, QCryptographicHash::Sha1).toHex().toUpper());
+        QByteArray controlFile = zsyncControlFileHeader("SerialScanTarget.AppImage", blockSize, targetLength, 1, targetSha1);
+        controlFile.append(zsyncCheckSumBlock(target.left(blockSize)));
+        controlFile.append(zsyncCheckSumBlock(target.mid(blockSize)));
+
+        RangeServer server("SerialScanTarget.zsync", controlFile, "SerialScanTarget.AppImage", targetLength, reader);
+        QVERIFY(server.listen());
+
+        QNetworkAccessManager manager;
+        ZsyncWriterPrivate writer(&manager);
+        writer.n_ScanThreads = 1;
+        QJsonObject result;
+        runZsyncUpdate(&writer, &manager, server.url("SerialScanTarget.zsync"), targetLength, seedPath, 60000, &result);
+        QVERIFY(!result.isEmpty());
+
+        QString targetPath = result["AbsolutePath"].toString();
+        QCOMPARE(result["Sha1Hash"].toString(), targetSha1);
+        /// Only the second block came from the server.
+        QCOMPARE(server.rangeBytesServed(), static_cast<qint64>(blockSize));
+
+        QFile::remove(targetPath);
+        QFile::remove(seedPath);
+    }
+
+    // Update a target from a seed which has all of it but a few short
+    // runs of blocks, Which are asked for in one multipart/byteranges
+    // request. The server cuts some of the parts short and splits the
+    // part boundaries over many reads, Or does not do multiple ranges at
+    // all and sends the whole target. The blocks which were not sent
+    // have to be asked for again.
+    void zsyncWriterMultiRangeFallbacks_data() {
+        QTest::addColumn<bool>("refuseMultiRange");
+
+        QTest::newRow("short parts") << false;
+        QTest::newRow("no multi range") << true;
+    }
+
+    void zsyncWriterMultiRangeFallbacks() {
+        QFETCH(bool, refuseMultiRange);
+
+        const qint32 blockSize = 4096;
+        const qint32 blocks = 10240; // 40 MiB.
+        const qint64 targetLength = static_cast<qint64>(blocks) * blockSize;
+        const qint32 runLength = 3;
+
+        /// Runs 5 MiB apart, Further than the downloader merges over.
+        auto isChanged = [](qint64 block) {
+            return block % 1280 >= 7 && block % 1280 < 7 + runLength;
+        };
+        RangeServer::Reader reader = [blockSize, isChanged](qint64 offset, char *out, qint64 length) {
+            for(qint64 i = 0; i < length; ++i) {
+                qint64 at = offset + i;
+                out[i] = isChanged(at / blockSize) ? static_cast<char>(((static_cast<quint64>(at) * 2654435761u) >> 24) | 1) : '\0';
+            }
+        };
+
+        QString seedPath = m_TempDir->path() + "/MultiRangeSeed.AppImage";
+        {
+            QFile seed(seedPath);
+            QVERIFY(seed.open(QIODevice::WriteOnly));
+            QVERIFY(seed.resize(targetLength));
+            seed.close();
+        }
+
+        QByteArray target(static_cast<int>(targetLength), '\0');
+        reader(0, target.data(), targetLength);
+        QString targetSha1 = QString(QCryptographicHash::hash(target, QCryptographicHash::Sha1).toHex().toUpper());
+        QByteArray controlFile = zsyncControlFileHeader("MultiRangeTarget.AppImage", blockSize, targetLength, 1, targetSha1);
+        for(qint32 i = 0; i < blocks; ++i) {
+            controlFile.append(zsyncCheckSumBlock(target.mid(i * blockSize, blockSize)));
+        }
+        target.clear();
+
+        RangeServer server("MultiRangeTarget.zsync", controlFile, "MultiRangeTarget.AppImage", targetLength, reader);
+        if(refuseMultiRange) {
+            server.setMultiRangeRefused(true);
+        } else {
+            server.setPartLimit(blockSize * 5 / 2, 3);
+            server.setLiteralWriteSize(7);
+        }
+        QVERIFY(server.listen());
+
+        /// One request at a time, So all the runs go in one request.
+        QNetworkAccessManager manager;
+        ZsyncWriterPrivate writer(&manager);
+        writer.setConcurrentRequests(1, 1);
+        QJsonObject result;
+        runZsyncUpdate(&writer, &manager, server.url("MultiRangeTarget.zsync"), targetLength, seedPath, 120000, &result);
+        QVERIFY(!result.isEmpty());
+
+        QString targetPath = result["AbsolutePath"].toString();
+        QCOMPARE(QFileInfo(targetPath).size(), targetLength);
+        QCOMPARE(result["Sha1Hash"].toString(), targetSha1);
+
+        auto requests = server.requestedRanges();
+        QVERIFY(requests.size() > 1);
+        QVERIFY(requests.first().size() > 1);
+
+        /// Returns true if a request after the first asked for the given byte.
+        auto askedAgain = [&requests](qint64 at) {
+            for(auto iter = requests.constBegin() + 1; iter != requests.constEnd(); ++iter) {
+                for(const auto &range : *iter) {
+                    if(range.first <= at && at <= range.second) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        };
+        if(refuseMultiRange) {
+            /// Every range of the refused request, One at a time.
+            for(const auto &range : requests.first()) {
+                QVERIFY(askedAgain(range.first));
+            }
+            for(auto iter = requests.constBegin() + 1; iter != requests.constEnd(); ++iter) {
+                QCOMPARE((*iter).size(), 1);
+            }
+        } else {
+            /// The rest of each cut part, From the first block it did not
+            /// have all of.
+            QCOMPARE(server.cutParts().size(), 3);
+            for(const auto &part : server.cutParts()) {
+                QVERIFY(askedAgain(((part.second + 1) / blockSize) * blockSize));
+            }
+        }
+
+        QFile::remove(targetPath);
+        QFile::remove(seedPath);
+    }
+
+    // Update a target with the .part file of an interrupted update next
+    // to it, Whose journal has all the blocks but which was cut short.
+    // The .part file has to be scanned like any other seed, So only the
+    // blocks past its end are downloaded, And removed after that.
+    void zsyncWriterShortJournaledFile() {
+        const qint32 blockSize = 4096;
+        const qint32 blocks = 64,
+                     partBlocks = 40;
+        const qint64 targetLength = static_cast<qint64>(blocks) * blockSize;
+
+        RangeServer::Reader reader = [](qint64 offset, char *out, qint64 length) {
+            for(qint64 i = 0; i < length; ++i) {
+                out[i] = static_cast<char>(((static_cast<quint64>(offset + i) * 2654435761u) >> 24) | 1);
+            }
+        };
+        QByteArray target(static_cast<int>(targetLength), '\0');
+        reader(0, target.data(), targetLength);
+        QString targetSha1 = QString(QCryptographicHash::hash(target, QCryptographicHash::Sha1).toHex().toUpper());
+        QByteArray controlFile = zsyncControlFileHeader("ShortPartTarget.AppImage", blockSize, targetLength, 1, targetSha1);
+        for(qint32 i = 0; i < blocks; ++i) {
+            controlFile.append(zsyncCheckSumBlock(target.mid(i * blockSize, blockSize)));
+        }
+
+        /// The seed has none of the target.
+        QString seedPath = m_TempDir->path() + "/ShortPartSeed.AppImage";
+        {
+            QFile seed(seedPath);
+            QVERIFY(seed.open(QIODevice::WriteOnly));
+            QVERIFY(seed.resize(blockSize));
+            seed.close();
+        }
+
+        QString partPath = m_TempDir->path() + "/ShortPartTarget.AppImage.interrupt.part";
+        {
+            QFile part(partPath);
+            QVERIFY(part.open(QIODevice::WriteOnly));
+            QCOMPARE(part.write(target.left(partBlocks * blockSize)), static_cast<qint64>(partBlocks) * blockSize);
+            part.close();
+
+            ZsyncBlockRanges known;
+            known.add(0, blocks - 1);
+            ZsyncJournal journal(targetSha1, targetLength, blockSize, blocks);
+            QVERIFY(journal.save(ZsyncJournal::pathOf(partPath), known));
+        }
+
+        RangeServer server("ShortPartTarget.zsync", controlFile, "ShortPartTarget.AppImage", targetLength, reader);
+        QVERIFY(server.listen());
+
+        QNetworkAccessManager manager;
+        ZsyncWriterPrivate writer(&manager);
+        QJsonObject result;
+        runZsyncUpdate(&writer, &manager, server.url("ShortPartTarget.zsync"), targetLength, seedPath, 60000, &result);
+        QVERIFY(!result.isEmpty());
+
+        QString targetPath = result["AbsolutePath"].toString();
+        QCOMPARE(result["Sha1Hash"].toString(), targetSha1);
+        QCOMPARE(server.rangeBytesServed(), static_cast<qint64>(blocks - partBlocks) * blockSize);
+        QVERIFY(!QFile::exists(partPath));
+        QVERIFY(!QFile::exists(ZsyncJournal::pathOf(partPath)));
+
+        QFile::remove(targetPath);
+        QFile::remove(seedPath);
+    }
+
+#ifndef QUICK_TEST
+    // Update a target larger than 2 GiB from a sparse seed file of the
+    // same size and make sure that the zsync writer handles offsets and
+    // lengths past the 32-bit limit.
+    //
+    // The control file is parsed as it would be for a real update and
+    // the target is served from localhost by a RangeServer. The target
+    // is all zeros except some blocks spread over it and its last short
+    // block, Those are not in the seed and have to be fetched with range
+    // requests.
+    void zsyncWriterLargeTarget() {
+        const qint32 blockSize = 1048576; // 1 MiB.
+        const qint64 targetLength = Q_INT64_C(3221225472) + blockSize / 2; // 3 GiB and a half block.
+        const qint32 blocks = static_cast<qint32>((targetLength + blockSize - 1) / blockSize);
+
+        auto isChanged = [blocks](qint64 block) {
+            return block % 97 == 5 || block == blocks - 1;
+        };
+        RangeServer::Reader reader = [blockSize, isChanged](qint64 offset, char *out, qint64 length) {
+            for(qint64 i = 0; i < length; ++i) {
+                qint64 at = offset + i;
+                out[i] = isChanged(at / blockSize) ? static_cast<char>(((static_cast<quint64>(at) * 2654435761u) >> 24) | 1) : '\0';
+            }
+        };
+
+        QString seedPath = m_TempDir->path() + "/LargeSeed.AppImage";
+        {
+            QFile seed(seedPath);
+            QVERIFY(seed.open(QIODevice::WriteOnly));
+            QVERIFY(seed.resize(targetLength));
+            seed.close();
+        }
+
+        const QByteArray zeroBlock(blockSize, '\0');
+        const QByteArray zeroCheckSumBlock = zsyncCheckSumBlock(zeroBlock);
+        QByteArray checkSumBlocks;
+        QCryptographicHash sha1(QCryptographicHash::Sha1);
+        qint64 changedBytes = 0;
+        for(qint32 i = 0; i < blocks; ++i) {
+            const qint64 offset = static_cast<qint64>(i) * blockSize;
+            const qint64 length = qMin<qint64>(blockSize, targetLength - offset);
+            if(!isChanged(i)) {
+                checkSumBlocks.append(zeroCheckSumBlock);
+                sha1.addData(zeroBlock.constData(), static_cast<int>(length));
+                continue;
+            }
+            QByteArray block(blockSize, '\0');
+            reader(offset, block.data(), length);
+            checkSumBlocks.append(zsyncCheckSumBlock(block));
+            sha1.addData(block.constData(), static_cast<int>(length));
+            changedBytes += length;
+        }
+        QString targetSha1 = QString(sha1.result().toHex().toUpper());
+
+        QByteArray controlFile = zsyncControlFileHeader("LargeTarget.AppImage", blockSize, targetLength, 1, targetSha1);
+        controlFile.append(checkSumBlocks);
+
+        RangeServer server("LargeTarget.zsync", controlFile, "LargeTarget.AppImage", targetLength, reader);
+        QVERIFY(server.listen());
+
+        QNetworkAccessManager manager;
+        ZsyncWriterPrivate writer(&manager);
+        QJsonObject result;
+        runZsyncUpdate(&writer, &manager, server.url("LargeTarget.zsync"), targetLength, seedPath, 600000, &result);
+        QVERIFY(!result.isEmpty());
+
+        QString targetPath = result["AbsolutePath"].toString();
+        QCOMPARE(QFileInfo(targetPath).size(), targetLength);
+        QCOMPARE(result["Sha1Hash"].toString(), targetSha1);
+
+        /// Only the changed blocks came from the server, Give or take
+        /// the gaps the downloader merged over.
+        QVERIFY(server.rangeBytesServed() >= changedBytes);
+        QVERIFY(server.rangeBytesServed() < changedBytes + 64 * static_cast<qint64>(blockSize));
+
+        QFile::remove(targetPath);
+        QFile::remove(seedPath);
+    }
+
+    // Time the rolling scan of submitSourceData over 4 MiB of seed with
+    // an empty seed filter, So every window is rolled and probed and
+    // nothing is ever matched. The generic rows scan with
+    // rollToCandidateGeneric and rsum_roll, The specialized rows with
+    // what buildHash picks for the configuration. Divide by 4194304 for
+    // the cost per byte.
+    void seedScanBenchmark_data() {
+        QTest::addColumn<int>("seqMatches");
+        QTest::addColumn<int>("weakBytes");
+        QTest::addColumn<int>("blockShift");
+        QTest::addColumn<bool>("specialized");
+
+        QTest::newRow("seq 2, 2 byte weak, 2048 generic") << 2 << 2 << 11 << false;
+        QTest::newRow("seq 2, 2 byte weak, 2048 specialized") << 2 << 2 << 11 << true;
+        QTest::newRow("seq 1, 4 byte weak, 4096 generic") << 1 << 4 << 12 << false;
+        QTest::newRow("seq 1, 4 byte weak, 4096 specialized") << 1 << 4 << 12 << true;
+    }
+
+    void seedScanBenchmark() {
+        QFETCH(int, seqMatches);
+        QFETCH(int, weakBytes);
+        QFETCH(int, blockShift);
+        QFETCH(bool, specialized);
+
+        /// A writer with no target blocks, Only what the scan reads is set.
+        QNetworkAccessManager manager;
+        ZsyncWriterPrivate writer(&manager);
+        writer.n_BlockSize = 1 << blockShift;
+        writer.n_BlockShift = blockShift;
+        writer.n_SeqMatches = seqMatches;
+        writer.n_Context = writer.n_BlockSize * seqMatches;
+        writer.n_WeakCheckSumBytes = weakBytes;
+        writer.p_WeakCheckSumMask = weakBytes < 3 ? 0 : weakBytes == 3 ? 0xff : 0xffff;
+        writer.n_StrongCheckSumBytes = 16;
+        QVERIFY(writer.buildHash());
+        if(!specialized) {
+            writer.p_RollToCandidate = &ZsyncWriterPrivate::rollToCandidateGeneric;
+        }
+
+        const qint32 length = 4194304;
+        QByteArray seed(length + writer.n_Context, '\0');
+        for(qint32 i = 0; i < seed.size(); ++i) {
+            seed[i] = static_cast<char>((i * 2654435761u) >> 24);
+        }
+        const unsigned char *data = reinterpret_cast<const unsigned char*>(seed.constData());
+
+        QBENCHMARK {
+            QCOMPARE(writer.submitSourceData(data, seed.size(), 0), 0);
+        }
+    }
+#endif // QUICK_TEST
+
     void cleanupTestCase(void) {
         m_TempDir->remove();
         emit finished();
@@ -604,6 +972,76 @@ class QAppImageUpdateTests : public QObject {
         QFAIL(QTest::toString(scode));
         return;
     }
+  private:
+    // The checksum record of the given block in a zsync control file,
+    // 4 byte rsum and 16 byte MD4 of the block.
+    static QByteArray zsyncCheckSumBlock(const QByteArray &block) {
+        const qint32 blockSize = block.size();
+        unsigned short a = 0,
+                       b = 0;
+        for(qint32 i = 0; i < blockSize; ++i) {
+            unsigned char c = static_cast<unsigned char>(block.at(i));
+            a += c;
+            b += (blockSize - i) * c;
+        }
+        QByteArray record;
+        record.append(static_cast<char>(a >> 8)).append(static_cast<char>(a))
+              .append(static_cast<char>(b >> 8)).append(static_cast<char>(b));
+        record.append(QCryptographicHash::hash(block, QCryptographicHash::Md4));
+        return record;
+    }
+
+    // The header of a zsync control file for the target served as
+    // fileName, The checksum records from zsyncCheckSumBlock follow it.
+    static QByteArray zsyncControlFileHeader(const QByteArray &fileName, qint32 blockSize, qint64 length,
+            qint32 seqMatches, const QString &sha1) {
+        return "zsync: 0.6.2\n"
+               "Filename: " + fileName + "\n"
+               "MTime: Sat, 17 Oct 2026 08:00:00 +0000\n"
+               "Blocksize: " + QByteArray::number(blockSize) + "\n"
+               "Length: " + QByteArray::number(length) + "\n"
+               "Hash-Lengths: " + QByteArray::number(seqMatches) + ",4,16\n"
+               "URL: " + fileName + "\n"
+               "SHA-1: " + sha1.toLower().toUtf8() + "\n\n";
+    }
+
+    // Parses the control file at the given url as it would be for a real
+    // update and then updates its target from the seed with the writer.
+    // Waits up to timeout ms for the writer to finish, result is left
+    // empty if it did not.
+    void runZsyncUpdate(ZsyncWriterPrivate *writer, QNetworkAccessManager *manager, const QUrl &controlFileUrl,
+                        qint64 targetLength, const QString &seedPath, int timeout, QJsonObject *result) {
+        ZsyncRemoteControlFileParserPrivate parser(manager);
+        auto failOnError = [](short code) {
+            auto scode = QAppImageUpdate::errorCodeToString(code);
+            scode.prepend("error:: ");
+            QFAIL(QTest::toString(scode));
+        };
+        connect(&parser, &ZsyncRemoteControlFileParserPrivate::error, failOnError);
+        connect(writer, &ZsyncWriterPrivate::error, failOnError);
+        connect(&parser, &ZsyncRemoteControlFileParserPrivate::receiveControlFile,
+                &parser, &ZsyncRemoteControlFileParserPrivate::getZsyncInformation);
+        connect(&parser, &ZsyncRemoteControlFileParserPrivate::zsyncInformation,
+        [&](qint32 parsedBlockSize, qint32 parsedBlocks, qint32 weakBytes, qint32 strongBytes,
+            qint32 seqMatches, qint64 parsedLength, QString, QString targetName,
+            QString parsedSha1, QUrl targetUrl, QBuffer *parsedCheckSumBlocks, bool rangeSupported, QUrl torrentUrl) {
+            QCOMPARE(parsedLength, targetLength);
+            QVERIFY(rangeSupported);
+            writer->setOutputDirectory(m_TempDir->path());
+            writer->setConfiguration(parsedBlockSize, parsedBlocks, weakBytes, strongBytes, seqMatches, parsedLength,
+                                     seedPath, targetName, parsedSha1, targetUrl, parsedCheckSumBlocks,
+                                     rangeSupported, torrentUrl);
+            writer->start();
+        });
+        QSignalSpy spyInfo(writer, SIGNAL(finished(QJsonObject, QString)));
+
+        parser.setControlFileUrl(controlFileUrl);
+        parser.getControlFile();
+
+        if(spyInfo.count() == 1 || spyInfo.wait(timeout)) {
+            *result = spyInfo.takeFirst().at(0).toJsonObject();
+        }
+    }
   Q_SIGNALS:
     void finished(void);
 };
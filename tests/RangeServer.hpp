@@ -0,0 +1,268 @@
+#ifndef RANGE_SERVER_HPP_INCLUDED
+#define RANGE_SERVER_HPP_INCLUDED
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QPair>
+#include <QSharedPointer>
+#include <QUrl>
+#include <functional>
+
+// HTTP server on localhost for a zsync control file and its target file,
+// The bytes of the target are made by the given reader when they are sent
+// so the target can be larger than the memory we have.
+// GET requests for the target may ask for one or more byte ranges, The
+// server can be told to answer them the way some real servers do.
+class RangeServer {
+  public:
+    // Fills out with length bytes of the target starting at offset.
+    typedef std::function<void(qint64, char*, qint64)> Reader;
+
+    RangeServer(const QString &controlFileName, const QByteArray &controlFile,
+                const QString &targetFileName, qint64 targetLength, Reader reader)
+        : m_ControlFileName("/" + controlFileName.toUtf8()),
+          m_ControlFile(controlFile),
+          m_TargetFileName("/" + targetFileName.toUtf8()),
+          n_TargetLength(targetLength),
+          m_Reader(reader) {
+        QObject::connect(&m_Server, &QTcpServer::newConnection, [this]() {
+            while(m_Server.hasPendingConnections()) {
+                serve(m_Server.nextPendingConnection());
+            }
+        });
+    }
+
+    bool listen() {
+        return m_Server.listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url(const QString &fileName) const {
+        return QUrl(QString("http://127.0.0.1:%1/%2").arg(m_Server.serverPort()).arg(fileName));
+    }
+
+    // Bytes of the target sent for requests with a Range header.
+    qint64 rangeBytesServed() const {
+        return n_RangeBytesServed;
+    }
+
+    // The ranges asked for by every request with a Range header, In the
+    // order the requests came in.
+    QList<QVector<QPair<qint64, qint64>>> requestedRanges() const {
+        return m_RequestedRanges;
+    }
+
+    // Cuts the next count parts of multipart responses which are longer
+    // than limit bytes to their first limit bytes, Their Content-Range
+    // says so.
+    void setPartLimit(qint64 limit, int count) {
+        n_PartLimit = limit;
+        n_PartsToCut = count;
+    }
+
+    // The parts cut by setPartLimit, As the first byte asked for and the
+    // last byte sent.
+    QVector<QPair<qint64, qint64>> cutParts() const {
+        return m_CutParts;
+    }
+
+    // Answers requests for more than one range with the whole target
+    // like servers without multipart support do.
+    void setMultiRangeRefused(bool refused) {
+        b_MultiRangeRefused = refused;
+    }
+
+    // Writes the status line, headers and part boundaries size bytes at
+    // a time and only once everything before them left, So they reach
+    // the client split over many reads.
+    void setLiteralWriteSize(qint64 size) {
+        n_LiteralWriteSize = size;
+    }
+  private:
+    // A piece of a response, Literal bytes or a range of the target.
+    struct Segment {
+        QByteArray bytes;
+        qint64 from,
+               to;
+    };
+
+    struct Connection {
+        QByteArray request;
+        QList<Segment> segments;
+        bool responding = false;
+    };
+
+    void serve(QTcpSocket *socket) {
+        auto connection = QSharedPointer<Connection>::create();
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        QObject::connect(socket, &QTcpSocket::readyRead, [this, socket, connection]() {
+            connection->request.append(socket->readAll());
+            if(connection->responding || !connection->request.contains("\r\n\r\n")) {
+                return;
+            }
+            connection->responding = true;
+            respond(connection.data());
+            pump(socket, connection.data());
+        });
+        QObject::connect(socket, &QTcpSocket::bytesWritten, [this, socket, connection]() {
+            pump(socket, connection.data());
+        });
+    }
+
+    // Writes the next pieces of the response while the socket has room.
+    void pump(QTcpSocket *socket, Connection *connection) {
+        const qint64 chunk = 1048576;
+        while(!connection->segments.isEmpty() && socket->bytesToWrite() < chunk
+                && socket->state() == QAbstractSocket::ConnectedState) {
+            Segment &segment = connection->segments.first();
+            if(segment.from > segment.to && n_LiteralWriteSize > 0) {
+                if(socket->bytesToWrite() > 0) {
+                    break;
+                }
+                socket->write(segment.bytes.left(static_cast<int>(n_LiteralWriteSize)));
+                segment.bytes.remove(0, static_cast<int>(n_LiteralWriteSize));
+                if(segment.bytes.isEmpty()) {
+                    connection->segments.removeFirst();
+                }
+                break;
+            }
+            if(segment.from > segment.to) {
+                socket->write(segment.bytes);
+                connection->segments.removeFirst();
+                continue;
+            }
+            qint64 length = qMin(chunk, segment.to - segment.from + 1);
+            QByteArray data(static_cast<int>(length), '\0');
+            m_Reader(segment.from, data.data(), length);
+            socket->write(data);
+            segment.from += length;
+            if(segment.from > segment.to) {
+                connection->segments.removeFirst();
+            }
+        }
+        if(connection->segments.isEmpty() && socket->bytesToWrite() == 0) {
+            socket->disconnectFromHost();
+        }
+    }
+
+    void respond(Connection *connection) {
+        QList<QByteArray> lines = connection->request.left(connection->request.indexOf("\r\n\r\n")).split('\n');
+        QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        QByteArray path = requestLine.size() > 1 ? requestLine.at(1) : QByteArray();
+        QByteArray range;
+        for(auto iter = lines.constBegin() + 1; iter != lines.constEnd(); ++iter) {
+            QByteArray line = (*iter).trimmed();
+            if(line.toLower().startsWith("range:")) {
+                range = line.mid(6).trimmed();
+            }
+        }
+
+        if(path == m_ControlFileName) {
+            connection->segments << literal(header("200 OK", m_ControlFile.size(), "application/octet-stream"))
+                                 << literal(m_ControlFile);
+            return;
+        }
+        if(path != m_TargetFileName) {
+            connection->segments << literal(header("404 Not Found", 0, "text/plain"));
+            return;
+        }
+        if(range.isEmpty()) {
+            connection->segments << literal(header("200 OK", n_TargetLength, "application/octet-stream"))
+                                 << Segment { QByteArray(), 0, n_TargetLength - 1 };
+            return;
+        }
+
+        QVector<QPair<qint64, qint64>> ranges;
+        for(const QByteArray &spec : range.mid(range.indexOf('=') + 1).split(',')) {
+            int dash = spec.indexOf('-');
+            qint64 from = spec.left(dash).trimmed().toLongLong(),
+                   to = qMin(spec.mid(dash + 1).trimmed().toLongLong(), n_TargetLength - 1);
+            if(from <= to) {
+                ranges.append(qMakePair(from, to));
+            }
+        }
+        if(ranges.isEmpty()) {
+            connection->segments << literal(header("416 Range Not Satisfiable", 0, "text/plain"));
+            return;
+        }
+        m_RequestedRanges.append(ranges);
+
+        if(ranges.size() > 1 && b_MultiRangeRefused) {
+            connection->segments << literal(header("200 OK", n_TargetLength, "application/octet-stream"))
+                                 << Segment { QByteArray(), 0, n_TargetLength - 1 };
+            return;
+        }
+
+        if(ranges.size() == 1) {
+            n_RangeBytesServed += ranges.first().second - ranges.first().first + 1;
+            connection->segments << literal(header("206 Partial Content", ranges.first().second - ranges.first().first + 1,
+                                                   "application/octet-stream", contentRange(ranges.first())))
+                                 << Segment { QByteArray(), ranges.first().first, ranges.first().second };
+            return;
+        }
+
+        const QByteArray boundary = "RANGE_SERVER_BOUNDARY";
+        QList<Segment> body;
+        qint64 length = 0;
+        for(auto iter = ranges.constBegin(); iter != ranges.constEnd(); ++iter) {
+            QPair<qint64, qint64> part = *iter;
+            if(n_PartsToCut > 0 && part.second - part.first + 1 > n_PartLimit) {
+                part.second = part.first + n_PartLimit - 1;
+                m_CutParts.append(part);
+                --n_PartsToCut;
+            }
+            QByteArray partHeader = "\r\n--" + boundary + "\r\n"
+                                    "Content-Type: application/octet-stream\r\n"
+                                    "Content-Range: " + contentRange(part) + "\r\n\r\n";
+            body << literal(partHeader) << Segment { QByteArray(), part.first, part.second };
+            length += partHeader.size() + part.second - part.first + 1;
+            n_RangeBytesServed += part.second - part.first + 1;
+        }
+        QByteArray closing = "\r\n--" + boundary + "--\r\n";
+        body << literal(closing);
+        length += closing.size();
+
+        connection->segments << literal(header("206 Partial Content", length,
+                                               "multipart/byteranges; boundary=" + boundary))
+                             << body;
+    }
+
+    QByteArray header(const QByteArray &status, qint64 length, const QByteArray &type,
+                      const QByteArray &range = QByteArray()) const {
+        QByteArray response = "HTTP/1.1 " + status + "\r\n"
+                              "Accept-Ranges: bytes\r\n"
+                              "Connection: close\r\n"
+                              "Content-Type: " + type + "\r\n"
+                              "Content-Length: " + QByteArray::number(length) + "\r\n";
+        if(!range.isEmpty()) {
+            response += "Content-Range: " + range + "\r\n";
+        }
+        return response + "\r\n";
+    }
+
+    QByteArray contentRange(const QPair<qint64, qint64> &range) const {
+        return "bytes " + QByteArray::number(range.first) + "-" + QByteArray::number(range.second) +
+               "/" + QByteArray::number(n_TargetLength);
+    }
+
+    static Segment literal(const QByteArray &bytes) {
+        return Segment { bytes, 0, -1 };
+    }
+
+    QTcpServer m_Server;
+    QByteArray m_ControlFileName,
+               m_ControlFile,
+               m_TargetFileName;
+    qint64 n_TargetLength;
+    qint64 n_RangeBytesServed = 0,
+           n_PartLimit = 0,
+           n_LiteralWriteSize = 0;
+    int n_PartsToCut = 0;
+    bool b_MultiRangeRefused = false;
+    QList<QVector<QPair<qint64, qint64>>> m_RequestedRanges;
+    QVector<QPair<qint64, qint64>> m_CutParts;
+    Reader m_Reader;
+};
+#endif // RANGE_SERVER_HPP_INCLUDED